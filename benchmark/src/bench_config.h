@@ -0,0 +1,441 @@
+#include "ecs/ecs.h"
+#include "ecs/rollback.h"
+
+// Components of the synthetic scenes, sized like typical gameplay data
+struct position
+{
+	float x, y, z;
+};
+
+struct velocity
+{
+	float x, y, z;
+};
+
+struct health
+{
+	int current, max;
+};
+
+struct ai_state
+{
+	uint32_t target;
+	float timer;
+	int mode;
+};
+
+struct bounds
+{
+	float min[3];
+	float max[3];
+};
+
+// Added to and removed from every entity by the add_remove benchmark
+struct lifetime
+{
+	float remaining;
+};
+
+// Half of every scene is frozen, the query benchmark skips those
+struct frozen {};
+
+// Added to and removed from every entity by the sparse benchmarks
+struct status
+{
+	float remaining;
+	uint32_t flags;
+};
+
+namespace engine
+{
+	template<>
+	struct component_storage<::status>
+	{
+		static const storage_policy policy = storage_sparse;
+	};
+}
+
+typedef engine::ecs_manager<position, velocity, health, ai_state, bounds, lifetime, frozen, status> bench_world;
+
+// Component types in bench_world, the component type benchmarks add filler types after them
+const uint32_t BENCH_TYPES = 8;
+
+// Only told apart by their ids, for worlds with many component types
+template<int I>
+struct filler
+{
+	uint32_t value;
+};
+
+// Components a mix can add to position and velocity, which every mix has as the systems run over them
+typedef std::tuple<health, ai_state, bounds> mix_components;
+const char* const MIX_COMPONENTS[] = { "health", "ai_state", "bounds" };
+
+struct mix_preset
+{
+	const char* name;
+	uint32_t components; // Bits of MIX_COMPONENTS
+};
+
+const mix_preset MIX_PRESETS[] = { { "minimal", 0 }, { "game", 3 }, { "wide", 7 } };
+
+struct bench_result
+{
+	std::string name;
+	std::string mix;
+	uint32_t entities;
+	uint64_t ops; // Entities spawned, visited, changed or destroyed over every pass
+	double ms;
+	uint64_t bytes; // Memory held by a rollback capture, 0 for the other benchmarks
+	double target_ms = 0; // Time the result should stay under, 0 if it has no target
+	uint32_t cores = 0; // Cores the job system benchmarks ran on, 0 for the others
+};
+
+class bench_timer
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+public:
+	double ms() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+};
+
+namespace bench_systems
+{
+	// position, velocity
+	void integrate(float dt, engine::span<position> p, engine::span<const velocity> v, engine::core_game_objects* cgo)
+	{
+		for (uint32_t i = 0; i < p.size; i++)
+		{
+			p[i].x += v[i].x * dt;
+			p[i].y += v[i].y * dt;
+			p[i].z += v[i].z * dt;
+		}
+	}
+
+	uint32_t visible = 0;
+
+	// position, without frozen
+	void cull(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		if (e.get<position>().x >= 0)
+			visible++;
+	}
+
+	// position, velocity, integrate run per entity so every component is found through entity::get
+	void move(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		position& p = e.get<position>();
+		const velocity& v = e.get<velocity>();
+
+		p.x += v.x * dt;
+		p.y += v.y * dt;
+		p.z += v.z * dt;
+	}
+
+	// status, walks the sparse pool rather than chunks
+	void expire(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		e.get<status>().remaining -= dt;
+	}
+
+	void nothing(void* data) {}
+}
+
+// Splits a command line list
+std::vector<std::string> split(const std::string& s, char separator)
+{
+	std::vector<std::string> parts;
+	std::stringstream ss(s);
+	for (std::string part; std::getline(ss, part, separator);)
+		parts.push_back(part);
+
+	return parts;
+}
+
+// A preset name or components joined by +, position and velocity may be listed but are always included
+bool parse_mix(const std::string& mix, uint32_t& components)
+{
+	for (const mix_preset& p : MIX_PRESETS)
+	{
+		if (mix == p.name)
+		{
+			components = p.components;
+			return true;
+		}
+	}
+
+	components = 0;
+	for (const std::string& c : split(mix, '+'))
+	{
+		bool found = c == "position" || c == "velocity";
+		for (uint32_t i = 0; i < std::size(MIX_COMPONENTS); i++)
+		{
+			if (c == MIX_COMPONENTS[i])
+			{
+				components |= 1 << i;
+				found = true;
+			}
+		}
+
+		if (!found)
+			return false;
+	}
+
+	return true;
+}
+
+// Runs every benchmark over a world of count entities with the components ts
+template<typename... ts>
+void run_mix(const char* mix, uint32_t count, std::vector<bench_result>& out)
+{
+	bench_world w;
+	w.add_system<position, const velocity>(3, bench_systems::integrate);
+	w.add_system<const position, engine::without<frozen>>(2, bench_systems::cull);
+	w.add_system<position, const velocity>(1, bench_systems::move);
+	w.add_system<status>(0, bench_systems::expire);
+
+	// Higher orders come first
+	engine::system& integrate = w.systems[0];
+	engine::system& cull = w.systems[1];
+	engine::system& move = w.systems[2];
+	engine::system& expire = w.systems[3];
+
+	// Small worlds are run more often so every result covers a similar amount of work
+	uint32_t passes = std::min(std::max(10000000 / count, (uint32_t)1), (uint32_t)1000);
+
+	std::vector<engine::entity_handle> hs;
+	{
+		bench_timer t;
+		hs = w.spawn_n<ts...>(count - count / 2, [](uint32_t i, ts&... c) {});
+		std::vector<engine::entity_handle> fs = w.spawn_n<ts..., frozen>(count / 2, [](uint32_t i, ts&... c, frozen& f) {});
+		out.push_back(bench_result{ "spawn", mix, count, count, t.ms(), 0 });
+
+		hs.insert(hs.end(), fs.begin(), fs.end());
+	}
+
+	{
+		bench_timer t;
+		for (uint32_t i = 0; i < passes; i++)
+			w.run_system(integrate, 1.0f / 60);
+		out.push_back(bench_result{ "iterate", mix, count, (uint64_t)count * passes, t.ms(), 0 });
+	}
+
+	{
+		bench_timer t;
+		for (uint32_t i = 0; i < passes; i++)
+			w.run_system(cull, 1.0f / 60);
+		out.push_back(bench_result{ "query", mix, count, (uint64_t)(count - count / 2) * passes, t.ms(), 0 });
+	}
+
+	// The same work as iterate, for the cost of each entity::get
+	{
+		bench_timer t;
+		for (uint32_t i = 0; i < passes; i++)
+			w.run_system(move, 1.0f / 60);
+		out.push_back(bench_result{ "iterate_get", mix, count, (uint64_t)count * passes, t.ms(), 0 });
+	}
+
+	{
+		bench_timer add;
+		for (engine::entity_handle h : hs)
+			w.get(h)->add<status>(status{ 1, 0 });
+		double add_ms = add.ms();
+
+		bench_timer t;
+		for (uint32_t i = 0; i < passes; i++)
+			w.run_system(expire, 1.0f / 60);
+		out.push_back(bench_result{ "sparse_iterate", mix, count, (uint64_t)count * passes, t.ms(), 0 });
+
+		bench_timer remove;
+		for (engine::entity_handle h : hs)
+			w.get(h)->remove<status>();
+		out.push_back(bench_result{ "sparse_add_remove", mix, count, (uint64_t)count * 2, add_ms + remove.ms(), 0 });
+	}
+
+	// Every chunk changes between the two captures, so the delta holds the whole world
+	{
+		engine::rollback_buffer rb(w, 2);
+		uint32_t first = rb.capture();
+		w.run_system(integrate, 1.0f / 60);
+
+		bench_timer t;
+		uint32_t second = rb.capture();
+		out.push_back(bench_result{ "capture", mix, count, count, t.ms(), rb.bytes(second) });
+
+		bench_timer r;
+		rb.restore(first);
+		out.push_back(bench_result{ "restore", mix, count, count, r.ms(), 0 });
+	}
+
+	{
+		bench_timer t;
+		for (engine::entity_handle h : hs)
+			w.get(h)->add<lifetime>(lifetime{ 1 });
+		for (engine::entity_handle h : hs)
+			w.get(h)->remove<lifetime>();
+		out.push_back(bench_result{ "add_remove", mix, count, (uint64_t)count * 2, t.ms(), 0 });
+	}
+
+	{
+		bench_timer t;
+		for (engine::entity_handle h : hs)
+			w.destroy_entity(h);
+		out.push_back(bench_result{ "destroy", mix, count, count, t.ms(), 0 });
+	}
+}
+
+// spawn_n should create one million position and velocity entities in well under this
+const double SPAWN_TARGET_MS = 50;
+
+// The median of several spawns into fresh worlds, tracked against SPAWN_TARGET_MS
+void run_spawn_target(std::vector<bench_result>& out)
+{
+	const uint32_t count = 1000000;
+
+	std::vector<double> times;
+	for (int i = 0; i < 5; i++)
+	{
+		bench_world w;
+
+		bench_timer t;
+		w.spawn_n<position, velocity>(count, [](uint32_t i, position& p, velocity& v) {});
+		times.push_back(t.ms());
+	}
+
+	std::sort(times.begin(), times.end());
+	out.push_back(bench_result{ "spawn_target", "minimal", count, count, times[times.size() / 2], 0, SPAWN_TARGET_MS });
+}
+
+// Runs run_mix with position, velocity and the MIX_COMPONENTS set in components
+template<int I = 0, typename... ts>
+void run_components(uint32_t components, const char* mix, uint32_t count, std::vector<bench_result>& out)
+{
+	if constexpr (I == std::tuple_size_v<mix_components>)
+		run_mix<position, velocity, ts...>(mix, count, out);
+	else if (components & (1 << I))
+		run_components<I + 1, ts..., std::tuple_element_t<I, mix_components>>(components, mix, count, out);
+	else
+		run_components<I + 1, ts...>(components, mix, count, out);
+}
+
+// Entities in every world of the component type benchmarks
+const uint32_t TYPES_ENTITIES = 100000;
+
+template<typename world, int I>
+void spawn_filler(world& w, uint32_t n, std::vector<engine::entity_handle>& hs)
+{
+	std::vector<engine::entity_handle> added = w.template spawn_n<position, velocity, filler<I>>(n, [](uint32_t i, position& p, velocity& v, filler<I>& f) {});
+	hs.insert(hs.end(), added.begin(), added.end());
+}
+
+// A world with BENCH_TYPES plus one filler type per index, its entities spread over one archetype per filler
+template<int... is>
+void run_types(std::integer_sequence<int, is...>, std::vector<bench_result>& out)
+{
+	typedef engine::ecs_manager<position, velocity, health, ai_state, bounds, lifetime, frozen, status, filler<is>...> world;
+	std::string mix = "types_" + std::to_string(BENCH_TYPES + sizeof...(is));
+	uint32_t count = TYPES_ENTITIES;
+	uint32_t passes = 100;
+
+	world w;
+	w.template add_system<position, const velocity>(1, bench_systems::integrate);
+	w.template add_system<const position, engine::without<frozen>>(0, bench_systems::cull);
+
+	engine::system& integrate = w.systems[0];
+	engine::system& cull = w.systems[1];
+
+	std::vector<engine::entity_handle> hs;
+	{
+		bench_timer t;
+		if constexpr (sizeof...(is) == 0)
+			hs = w.template spawn_n<position, velocity>(count, [](uint32_t i, position& p, velocity& v) {});
+		else
+			(spawn_filler<world, is>(w, count / sizeof...(is), hs), ...);
+		out.push_back(bench_result{ "types_spawn", mix, (uint32_t)hs.size(), hs.size(), t.ms(), 0 });
+	}
+
+	{
+		bench_timer t;
+		for (uint32_t i = 0; i < passes; i++)
+			w.run_system(integrate, 1.0f / 60);
+		out.push_back(bench_result{ "types_iterate", mix, (uint32_t)hs.size(), (uint64_t)hs.size() * passes, t.ms(), 0 });
+	}
+
+	{
+		bench_timer t;
+		for (uint32_t i = 0; i < passes; i++)
+			w.run_system(cull, 1.0f / 60);
+		out.push_back(bench_result{ "types_query", mix, (uint32_t)hs.size(), (uint64_t)hs.size() * passes, t.ms(), 0 });
+	}
+
+	// Every move looks its archetype up by a mask as wide as the component count
+	{
+		bench_timer t;
+		for (engine::entity_handle h : hs)
+			w.get(h)->template add<lifetime>(lifetime{ 1 });
+		for (engine::entity_handle h : hs)
+			w.get(h)->template remove<lifetime>();
+		out.push_back(bench_result{ "types_add_remove", mix, (uint32_t)hs.size(), (uint64_t)hs.size() * 2, t.ms(), 0 });
+	}
+}
+
+// Masks only hold ENGINE_MAX_COMPONENTS, wider worlds need the engine and benchmark built with a larger value
+template<uint32_t types>
+void run_types(std::vector<bench_result>& out)
+{
+	if constexpr (types > ENGINE_MAX_COMPONENTS)
+		std::cerr << types << " component types skipped, the engine and benchmark need building with ENGINE_MAX_COMPONENTS of at least " << types << std::endl;
+	else
+		run_types(std::make_integer_sequence<int, types - BENCH_TYPES>(), out);
+}
+
+// Jobs submitted and waited on by the job overhead benchmark, in batches that fit a queue
+const uint32_t OVERHEAD_JOBS = 200000;
+const uint32_t OVERHEAD_BATCH = 1000;
+
+// Empty jobs for the cost of submitting and running one, then a parallel_for over a fixed amount of work, from 1 core up to every core
+void run_jobs(std::vector<bench_result>& out)
+{
+	uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<float> work(1 << 22, 1.0f);
+	uint32_t passes = 20;
+
+	for (uint32_t c = 1;; c = std::min(c * 2, cores))
+	{
+		engine::job_system jobs(c - 1);
+
+		{
+			bench_timer t;
+			for (uint32_t b = 0; b < OVERHEAD_JOBS / OVERHEAD_BATCH; b++)
+			{
+				engine::job_counter counter{ 0 };
+				for (uint32_t i = 0; i < OVERHEAD_BATCH; i++)
+					jobs.submit(engine::job{ bench_systems::nothing, nullptr }, &counter);
+				jobs.wait(counter);
+			}
+
+			bench_result r{ "job_overhead", "jobs", 0, OVERHEAD_JOBS, t.ms(), 0 };
+			r.cores = c;
+			out.push_back(r);
+		}
+
+		{
+			bench_timer t;
+			for (uint32_t i = 0; i < passes; i++)
+			{
+				jobs.parallel_for(work.size(), 0, [&](uint32_t b, uint32_t e)
+				{
+					for (uint32_t j = b; j < e; j++)
+						work[j] = std::sqrt(work[j] + 1.0f);
+				});
+			}
+
+			bench_result r{ "job_scaling", "jobs", 0, (uint64_t)work.size() * passes, t.ms(), 0 };
+			r.cores = c;
+			out.push_back(r);
+		}
+
+		if (c == cores)
+			break;
+	}
+}
@@ -0,0 +1,124 @@
+#include "bench_config.h"
+
+// Usage: benchmark [--min n] [--max n] [--mix mixes] [--suite mixes|types|jobs] [--out path]
+// Scenes go from min to max entities in steps of 10, and the results are written as JSON to path or stdout
+// mixes is a comma separated list of presets (minimal, game, wide) or components joined by +, such as position+velocity+bounds
+// Suites are also comma separated and all of them run by default
+int main(int argc, char** argv)
+{
+	uint32_t min = 1000;
+	uint32_t max = 10000000;
+	std::string mixes = "minimal,game,wide";
+	std::string suites = "mixes,types,jobs";
+	std::string path;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "--min")
+			min = std::stoul(argv[i + 1]);
+		else if (arg == "--max")
+			max = std::stoul(argv[i + 1]);
+		else if (arg == "--mix")
+			mixes = argv[i + 1];
+		else if (arg == "--suite")
+			suites = argv[i + 1];
+		else if (arg == "--out")
+			path = argv[i + 1];
+		else
+		{
+			std::cerr << "Unknown argument " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<std::string> names = split(mixes, ',');
+	std::vector<uint32_t> components(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (!parse_mix(names[i], components[i]))
+		{
+			std::cerr << "Unknown mix " << names[i] << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<std::string> run = split(suites, ',');
+	for (const std::string& suite : run)
+	{
+		if (suite != "mixes" && suite != "types" && suite != "jobs")
+		{
+			std::cerr << "Unknown suite " << suite << std::endl;
+			return 1;
+		}
+	}
+	auto runs = [&](const char* suite) { return std::find(run.begin(), run.end(), suite) != run.end(); };
+
+	std::vector<bench_result> results;
+
+	if (runs("mixes"))
+	{
+		if (std::find(components.begin(), components.end(), 0) != components.end())
+			run_spawn_target(results);
+
+		for (uint64_t n = std::max(min, (uint32_t)2); n <= max; n *= 10)
+		{
+			uint32_t count = (uint32_t)n;
+			std::cerr << count << " entities" << std::endl;
+
+			for (size_t i = 0; i < names.size(); i++)
+				run_components(components[i], names[i].c_str(), count, results);
+		}
+	}
+
+	if (runs("types"))
+	{
+		std::cerr << "component types" << std::endl;
+		run_types<8>(results);
+		run_types<64>(results);
+		run_types<256>(results);
+	}
+
+	if (runs("jobs"))
+	{
+		std::cerr << "job system" << std::endl;
+		run_jobs(results);
+	}
+
+	for (bench_result& r : results)
+	{
+		if (r.target_ms > 0 && r.ms >= r.target_ms)
+			std::cerr << r.name << " took " << r.ms << " ms, over its target of " << r.target_ms << " ms" << std::endl;
+	}
+
+	std::ofstream file;
+	if (!path.empty())
+		file.open(path);
+	std::ostream& o = path.empty() ? std::cout : file;
+
+	o << "{\n";
+	o << "  \"max_components\": " << ENGINE_MAX_COMPONENTS << ",\n";
+	o << "  \"chunk_size\": " << engine::CHUNK_SIZE << ",\n";
+	o << "  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		bench_result& r = results[i];
+		double ops_per_s = r.ms > 0 ? r.ops / (r.ms / 1000) : 0;
+
+		o << "    { \"name\": \"" << r.name << "\", \"mix\": \"" << r.mix << "\", \"entities\": " << r.entities
+			<< ", \"ops\": " << r.ops << ", \"ms\": " << r.ms << ", \"ops_per_s\": " << (uint64_t)ops_per_s;
+		if (r.bytes)
+			o << ", \"bytes\": " << r.bytes;
+		if (r.cores)
+			o << ", \"cores\": " << r.cores;
+		if (r.target_ms > 0)
+			o << ", \"target_ms\": " << r.target_ms << ", \"met\": " << (r.ms < r.target_ms ? "true" : "false");
+		o << " }" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	o << "  ]\n";
+	o << "}\n";
+
+	return 0;
+}
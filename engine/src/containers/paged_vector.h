@@ -0,0 +1,91 @@
+#pragma once
+
+#include "pch.h"
+
+namespace engine
+{
+	const uint32_t DEFAULT_PAGE_SIZE = 1024;
+
+	// Grows a page of PAGE_SIZE elements at a time, pages never move so references stay valid until their element is popped or assigned over
+	template<typename T, uint32_t PAGE_SIZE = DEFAULT_PAGE_SIZE>
+	class paged_vector
+	{
+	public:
+		static const uint32_t page_size = PAGE_SIZE;
+
+		paged_vector() {}
+		~paged_vector()
+		{
+			clear();
+			for (T* p : pages)
+				operator delete(p, std::align_val_t(alignof(T)));
+		}
+
+		paged_vector(const paged_vector& v)
+		{
+			for (uint32_t i = 0; i < v.count; i++)
+				push_back(v[i]);
+		}
+		paged_vector& operator=(const paged_vector& v)
+		{
+			if (this != &v)
+			{
+				clear();
+				for (uint32_t i = 0; i < v.count; i++)
+					push_back(v[i]);
+			}
+			return *this;
+		}
+
+		// Takes the pages, so references into v now refer into this
+		paged_vector(paged_vector&& v) noexcept : pages(std::move(v.pages)), count(v.count)
+		{
+			v.pages.clear();
+			v.count = 0;
+		}
+		paged_vector& operator=(paged_vector&& v) noexcept
+		{
+			std::swap(pages, v.pages);
+			std::swap(count, v.count);
+			return *this;
+		}
+
+		inline T& operator[](uint32_t i) { return pages[i / PAGE_SIZE][i % PAGE_SIZE]; }
+		inline const T& operator[](uint32_t i) const { return pages[i / PAGE_SIZE][i % PAGE_SIZE]; }
+
+		uint32_t size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		T& back() { return (*this)[count - 1]; }
+
+		template<typename... as>
+		T& emplace_back(as&&... args)
+		{
+			if (count == pages.size() * PAGE_SIZE)
+				pages.push_back((T*)operator new(sizeof(T) * PAGE_SIZE, std::align_val_t(alignof(T))));
+
+			T* t = new (&pages[count / PAGE_SIZE][count % PAGE_SIZE]) T(std::forward<as>(args)...);
+			count++;
+
+			return *t;
+		}
+		T& push_back(T v) { return emplace_back(std::move(v)); }
+
+		void pop_back()
+		{
+			count--;
+			(*this)[count].~T();
+		}
+
+		// Pages are kept for reuse
+		void clear()
+		{
+			while (count > 0)
+				pop_back();
+		}
+
+	private:
+		std::vector<T*> pages;
+		uint32_t count = 0;
+	};
+}
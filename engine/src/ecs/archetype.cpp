@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "archetype.h"
+#include "ecs.h"
+
+namespace engine
+{
+	static uint32_t align_up(uint32_t v, uint32_t a)
+	{
+		return (v + a - 1) / a * a;
+	}
+
+	archetype::archetype(ecs_storage* o, const ecs_mask& s, const ecs_mask& m, const std::vector<component_info>& cs, int no_ids) : owner(o), storage(s), mask(m), columns(cs), offsets(no_ids, NO_COLUMN), tick_offsets(no_ids, NO_COLUMN)
+	{
+		uint32_t row_size = sizeof(uint32_t);
+		for (component_info& c : columns)
+			row_size += c.size + sizeof(uint32_t);
+
+		capacity = std::max(CHUNK_SIZE / row_size, (uint32_t)1);
+
+		// Shrink until every column fits once aligned
+		while (true)
+		{
+			uint32_t offset = capacity * sizeof(uint32_t);
+			for (component_info& c : columns)
+			{
+				offset = align_up(offset, c.align);
+				offsets[c.id] = offset;
+				offset += capacity * c.size;
+
+				offset = align_up(offset, alignof(uint32_t));
+				tick_offsets[c.id] = offset;
+				offset += (capacity + 1) * sizeof(uint32_t);
+			}
+
+			if (offset <= CHUNK_SIZE)
+				break;
+			if (capacity == 1)
+				throw std::runtime_error("Archetype row does not fit in a chunk");
+
+			capacity--;
+		}
+	}
+
+	archetype::~archetype()
+	{
+		for (chunk& c : chunks)
+		{
+			for (component_info& ci : columns)
+			{
+				for (uint32_t r = 0; r < c.count; r++)
+					ci.destroy(c.data + offsets[ci.id] + r * ci.size);
+			}
+
+			if (!c.mapped)
+				operator delete(c.data, std::align_val_t(CHUNK_ALIGN));
+		}
+	}
+
+	void archetype::reserve(uint32_t n)
+	{
+		while (chunks.size() * capacity < count + n)
+		{
+			chunk c;
+			c.data = (uint8_t*)operator new(CHUNK_SIZE, std::align_val_t(CHUNK_ALIGN));
+
+			for (component_info& info : columns)
+				chunk_tick(c, info.id) = owner->tick_floor;
+
+			chunks.push_back(c);
+		}
+	}
+
+	void archetype::allocate(uint32_t e, uint32_t& ci, uint32_t& row)
+	{
+		reserve(1);
+
+		// Every chunk before the last used one is full
+		ci = count / capacity;
+		chunk& c = chunks[ci];
+		row = c.count;
+
+		entity_ids(c)[row] = e;
+		c.structure_tick = owner->edit_tick();
+
+		c.count++;
+		count++;
+	}
+
+	uint32_t archetype::allocate_run(uint32_t n, uint32_t tick, uint32_t& ci, uint32_t& row)
+	{
+		reserve(1);
+
+		ci = count / capacity;
+		chunk& c = chunks[ci];
+		row = c.count;
+
+		uint32_t k = std::min(n, capacity - c.count);
+		for (component_info& info : columns)
+		{
+			uint32_t* t = ticks(c, info.id);
+			std::fill(t + row, t + row + k, tick);
+			if (newer(tick, chunk_tick(c, info.id)))
+				chunk_tick(c, info.id) = tick;
+		}
+
+		c.structure_tick = tick;
+		c.count += k;
+		count += k;
+
+		return k;
+	}
+
+	void archetype::mark_all(uint32_t ci, uint32_t row, uint32_t tick)
+	{
+		for (component_info& info : columns)
+			mark(ci, row, info.id, tick);
+	}
+
+	void archetype::age_ticks(uint32_t floor)
+	{
+		auto age = [&](uint32_t& t)
+		{
+			if (newer(floor, t))
+				t = floor;
+		};
+
+		for (chunk& c : chunks)
+		{
+			age(c.structure_tick);
+
+			for (component_info& info : columns)
+			{
+				age(chunk_tick(c, info.id));
+
+				uint32_t* t = ticks(c, info.id);
+				for (uint32_t r = 0; r < c.count; r++)
+					age(t[r]);
+			}
+		}
+	}
+
+	uint32_t archetype::remove(uint32_t ci, uint32_t row, bool destroy)
+	{
+		if (destroy)
+		{
+			for (component_info& info : columns)
+				info.destroy(get(ci, row, info));
+		}
+
+		uint32_t last_ci = (count - 1) / capacity;
+		chunk& last = chunks[last_ci];
+		uint32_t last_row = last.count - 1;
+
+		uint32_t moved = NO_COLUMN;
+		if (ci != last_ci || row != last_row)
+		{
+			for (component_info& info : columns)
+			{
+				info.move(get(ci, row, info), get(last_ci, last_row, info));
+				mark(ci, row, info.id, ticks(last, info.id)[last_row]);
+			}
+
+			moved = entity_ids(last)[last_row];
+			entity_ids(chunks[ci])[row] = moved;
+		}
+
+		uint32_t tick = owner->edit_tick();
+		chunks[ci].structure_tick = tick;
+		last.structure_tick = tick;
+
+		last.count--;
+		count--;
+
+		release_chunks();
+
+		return moved;
+	}
+
+	void archetype::restore_count(uint32_t n)
+	{
+		reserve(n > count ? n - count : 0);
+
+		count = n;
+		for (uint32_t ci = 0; ci < chunks.size(); ci++)
+			chunks[ci].count = std::min(capacity, n - std::min(n, ci * capacity));
+
+		release_chunks();
+	}
+
+	void archetype::release_chunks()
+	{
+		// One empty chunk is kept past the used ones, so entities coming and going around a chunk boundary do not allocate and free it each time
+		uint32_t keep = (count + capacity - 1) / capacity + 1;
+		while (chunks.size() > keep)
+		{
+			if (!chunks.back().mapped)
+				operator delete(chunks.back().data, std::align_val_t(CHUNK_ALIGN));
+			chunks.pop_back();
+		}
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "pch.h"
+
+#include "ecs/mask.h"
+#include "ecs/shared.h"
+
+namespace engine
+{
+	typedef uint16_t component_index;
+
+	class ecs_storage;
+
+	const uint32_t CHUNK_SIZE = 16 * 1024;
+	const uint32_t CHUNK_ALIGN = 64;
+	const uint32_t NO_COLUMN = UINT32_MAX;
+	const uint32_t NO_ENTITY = UINT32_MAX;
+
+	// Change ticks wrap, a tick is newer than another if it is less than half the tick range ahead of it
+	// ecs_storage::age_ticks keeps every tick it holds within a quarter of the range of each other
+	inline bool newer(uint32_t t, uint32_t than) { return (int32_t)(t - than) > 0; }
+
+	struct component_info
+	{
+		component_index id = 0;
+		uint32_t size = 0;
+		uint32_t align = 1;
+		bool trivial = false; // Trivially copyable, so the component can be written to and read from snapshots as bytes
+		bool tag = false; // Empty type, only kept as a bit in the archetype masks and never given a column
+		bool pointer = false; // A shared<T>, trivially copyable but pointing into the world's shared_table, so its bytes mean nothing in another world
+
+		void (*move)(void* dst, void* src) = nullptr; // Move constructs dst from src and destroys src
+		void (*destroy)(void* p) = nullptr;
+
+		template<typename T>
+		static component_info of(component_index i)
+		{
+			component_info ci;
+			ci.id = i;
+			ci.tag = std::is_empty_v<T>;
+			ci.size = ci.tag ? 0 : sizeof(T);
+			ci.align = alignof(T);
+			ci.trivial = std::is_trivially_copyable_v<T>;
+			ci.pointer = is_shared<T>;
+			ci.move = [](void* dst, void* src) { new (dst) T(std::move(*(T*)src)); ((T*)src)->~T(); };
+			ci.destroy = [](void* p) { ((T*)p)->~T(); };
+
+			return ci;
+		}
+	};
+
+	// A fixed size block holding up to archetype::capacity entities, one column per component
+	struct chunk
+	{
+		uint8_t* data;
+		uint32_t count = 0;
+		bool mapped = false; // Points into a loaded snapshot rather than being allocated by the archetype
+		uint32_t structure_tick = 0; // Change tick of the last row added or removed
+	};
+
+	// Every entity with the same set of stored (storage) and enabled (mask) components lives in the same archetype
+	class archetype
+	{
+	public:
+		ecs_storage* owner;
+
+		ecs_mask storage;
+		ecs_mask mask;
+
+		std::vector<component_info> columns;
+		std::vector<uint32_t> offsets; // Indexed by component id, NO_COLUMN if not stored
+		std::vector<uint32_t> tick_offsets; // Indexed by component id, the chunk's tick followed by one per row
+
+		uint32_t capacity;
+		uint32_t count = 0;
+		std::vector<chunk> chunks;
+
+		archetype(ecs_storage* o, const ecs_mask& s, const ecs_mask& m, const std::vector<component_info>& cs, int no_ids);
+		~archetype();
+
+		archetype(const archetype&) = delete;
+		archetype& operator=(const archetype&) = delete;
+
+		bool has(component_index id) const { return offsets[id] != NO_COLUMN; }
+
+		uint32_t* entity_ids(const chunk& c) { return (uint32_t*)c.data; }
+
+		template<typename T>
+		T* column(const chunk& c, component_index id) { return (T*)(c.data + offsets[id]); }
+
+		void* get(uint32_t ci, uint32_t row, const component_info& info) { return chunks[ci].data + offsets[info.id] + row * info.size; }
+
+		// Latest change tick of a column in the chunk, and of each row
+		uint32_t& chunk_tick(const chunk& c, component_index id) { return *(uint32_t*)(c.data + tick_offsets[id]); }
+		uint32_t* ticks(const chunk& c, component_index id) { return (uint32_t*)(c.data + tick_offsets[id]) + 1; }
+
+		void mark(uint32_t ci, uint32_t row, component_index id, uint32_t tick)
+		{
+			chunk& c = chunks[ci];
+			ticks(c, id)[row] = tick;
+			if (newer(tick, chunk_tick(c, id)))
+				chunk_tick(c, id) = tick;
+		}
+		// Marks every column of the row, for newly constructed entities
+		void mark_all(uint32_t ci, uint32_t row, uint32_t tick);
+		// Raises every tick older than floor to it
+		void age_ticks(uint32_t floor);
+
+		// Makes sure chunks exist for n more entities, so a batch of allocations only allocates chunks once
+		void reserve(uint32_t n);
+		// Reserves a row at the end of the archetype, component data is left unconstructed
+		void allocate(uint32_t e, uint32_t& ci, uint32_t& row);
+		// Reserves up to n rows at the end of the last chunk with room, marked with tick, returns how many were reserved
+		// Entity ids are left for the caller to fill in
+		uint32_t allocate_run(uint32_t n, uint32_t tick, uint32_t& ci, uint32_t& row);
+		// Fills the row with the last entity of the archetype, returns the id of the moved entity or NO_COLUMN
+		uint32_t remove(uint32_t ci, uint32_t row, bool destroy);
+		// Sets the entity count without constructing or destroying anything, for restoring chunks as bytes
+		void restore_count(uint32_t n);
+		// Frees the chunks past the used ones, apart from one spare
+		void release_chunks();
+	};
+}
@@ -0,0 +1,66 @@
+#include "pch.h"
+#include "command_buffer.h"
+
+namespace engine
+{
+	void command_buffer::destroy(entity_handle h)
+	{
+		command& c = push(command_destroy, h);
+		c.apply = [](ecs_storage& st, command& c, archetype* a)
+		{
+			st.destroy_entity(c.target);
+		};
+	}
+
+	void command_buffer::clear(bool discard)
+	{
+		if (discard)
+		{
+			for (command* c : commands)
+				c->discard(*c);
+		}
+
+		commands.clear();
+		next_sequence = 0;
+		current = 0;
+		offset = 0;
+	}
+
+	void* command_buffer::allocate(size_t size, size_t align)
+	{
+		while (true)
+		{
+			if (current == blocks.size())
+			{
+				block b;
+				b.size = std::max(size, BLOCK_SIZE);
+				b.data.reset(new uint8_t[b.size]);
+				blocks.push_back(std::move(b));
+			}
+
+			size_t start = (offset + align - 1) / align * align;
+			if (start + size <= blocks[current].size)
+			{
+				offset = start + size;
+				return blocks[current].data.get() + start;
+			}
+
+			current++;
+			offset = 0;
+		}
+	}
+
+	command& command_buffer::push(command_type type, entity_handle h)
+	{
+		command* c = new (allocate(sizeof(command), alignof(command))) command();
+		c->type = type;
+		c->target = h;
+		c->sequence = next_sequence++;
+		c->component = 0;
+		c->discard = &command_buffer::discard_nothing;
+		c->payload = nullptr;
+
+		commands.push_back(c);
+		return *c;
+	}
+}
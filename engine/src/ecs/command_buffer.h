@@ -0,0 +1,188 @@
+#pragma once
+
+#include "pch.h"
+
+#include "ecs/ecs.h"
+
+namespace engine
+{
+	enum command_type
+	{
+		command_spawn,
+		command_destroy,
+		command_add,
+		command_remove,
+		command_enable,
+		command_disable,
+	};
+
+	struct command
+	{
+		command_type type;
+		entity_handle target;
+		ecs_mask mask; // Archetype components of a spawn
+		component_index component; // Component of a remove or disable
+		// The recording system's place in the schedule and the command's place among that system's commands, 0 outside of systems
+		// Which thread ran the system does not matter, so playback order is the same on every run
+		uint64_t sequence;
+		uint32_t index; // Position in ecs_storage::playback before sorting, orders commands recorded outside of systems
+
+		// a is the spawn's archetype, found once per batch of spawns with the same mask
+		void (*apply)(ecs_storage& st, command& c, archetype* a);
+		// Destroys the payload of a command that is never played back
+		void (*discard)(command& c);
+		void* payload;
+	};
+
+	// Records structural changes so they can be made from inside a running system, and played back by ecs_storage::flush
+	class command_buffer
+	{
+	public:
+		static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+		std::vector<command*> commands;
+		// Sequence of the next command recorded, set by ecs_storage::run_system while a system runs on the buffer's thread
+		uint64_t next_sequence = 0;
+
+		command_buffer() {}
+		~command_buffer() { clear(true); }
+
+		command_buffer(const command_buffer&) = delete;
+		command_buffer& operator=(const command_buffer&) = delete;
+		command_buffer(command_buffer&&) = default;
+		command_buffer& operator=(command_buffer&&) = default;
+
+		template<typename... ts>
+		void spawn(ts... data);
+		void destroy(entity_handle h);
+
+		template<typename T>
+		void add(entity_handle h, T c);
+		template<typename T>
+		void remove(entity_handle h);
+
+		template<typename T>
+		void enable(entity_handle h);
+		template<typename T>
+		void disable(entity_handle h);
+
+		// Forgets every command, payloads are destroyed when discard is set and assumed consumed by playback otherwise
+		void clear(bool discard);
+
+	private:
+		struct block
+		{
+			std::unique_ptr<uint8_t[]> data;
+			size_t size;
+		};
+
+		// Blocks are kept between frames, so recording only allocates while the buffer grows
+		std::vector<block> blocks;
+		size_t current = 0;
+		size_t offset = 0;
+
+		void* allocate(size_t size, size_t align);
+		command& push(command_type type, entity_handle h);
+
+		template<typename T>
+		static void discard_payload(command& c) { ((T*)c.payload)->~T(); }
+		static void discard_nothing(command& c) {}
+
+		template<typename t>
+		static void construct(ecs_storage& st, entity& e, t& v);
+		template<typename t>
+		static void mask_helper(ecs_mask& m);
+	};
+
+	template<typename... ts>
+	void command_buffer::spawn(ts... data)
+	{
+		typedef std::tuple<ts...> payload_type;
+		static_assert(alignof(payload_type) <= alignof(std::max_align_t), "Blocks are only aligned to max_align_t");
+
+		command& c = push(command_spawn, entity_handle());
+		c.payload = new (allocate(sizeof(payload_type), alignof(payload_type))) payload_type(std::move(data)...);
+		c.discard = &command_buffer::discard_payload<payload_type>;
+		c.apply = [](ecs_storage& st, command& c, archetype* a)
+		{
+			payload_type& p = *(payload_type*)c.payload;
+
+			entity& e = st.create_entity(a);
+			std::apply([&](ts&... v) { (construct<ts>(st, e, v), ...); }, p);
+
+			p.~payload_type();
+		};
+
+		(mask_helper<ts>(c.mask), ...);
+	}
+
+	template<typename t>
+	void command_buffer::construct(ecs_storage& st, entity& e, t& v)
+	{
+		if constexpr (is_sparse<t>)
+			st.pool<t>().add(e.id, std::move(v));
+		else if constexpr (!is_tag<t>)
+			new (&e.get<t>()) t(std::move(v));
+	}
+
+	template<typename t>
+	void command_buffer::mask_helper(ecs_mask& m)
+	{
+		if constexpr (!is_sparse<t>)
+			m.set(component_type<t>::id);
+	}
+
+	template<typename T>
+	void command_buffer::add(entity_handle h, T v)
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Blocks are only aligned to max_align_t");
+
+		command& c = push(command_add, h);
+		c.payload = new (allocate(sizeof(T), alignof(T))) T(std::move(v));
+		c.discard = &command_buffer::discard_payload<T>;
+		c.apply = [](ecs_storage& st, command& c, archetype* a)
+		{
+			T& v = *(T*)c.payload;
+
+			if (entity* e = st.get(c.target))
+				e->add<T>(std::move(v));
+
+			v.~T();
+		};
+	}
+
+	template<typename T>
+	void command_buffer::remove(entity_handle h)
+	{
+		command& c = push(command_remove, h);
+		c.component = component_type<T>::id;
+		c.apply = [](ecs_storage& st, command& c, archetype* a)
+		{
+			if (entity* e = st.get(c.target))
+				e->remove<T>();
+		};
+	}
+
+	template<typename T>
+	void command_buffer::enable(entity_handle h)
+	{
+		command& c = push(command_enable, h);
+		c.apply = [](ecs_storage& st, command& c, archetype* a)
+		{
+			if (entity* e = st.get(c.target))
+				e->enable<T>();
+		};
+	}
+
+	template<typename T>
+	void command_buffer::disable(entity_handle h)
+	{
+		command& c = push(command_disable, h);
+		c.component = component_type<T>::id;
+		c.apply = [](ecs_storage& st, command& c, archetype* a)
+		{
+			if (entity* e = st.get(c.target))
+				e->disable<T>();
+		};
+	}
+}
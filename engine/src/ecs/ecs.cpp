@@ -1,10 +1,786 @@
 #include "pch.h"
 #include "ecs.h"
+#include "command_buffer.h"
+#include "snapshot.h"
+#include "hierarchy.h"
 
 namespace engine
 {
-	int id_counter = 1;
+	ecs_storage::ecs_storage(int mask_words, int profiled) : component_infos(1), pools(1), command_buffers(1)
+	{
+		if (mask_words != NO_COMPONENT_IS)
+			throw std::runtime_error("ENGINE_MAX_COMPONENTS differs between the engine and the project");
+		if (profiled != ENGINE_PROFILE)
+			throw std::runtime_error("ENGINE_PROFILE differs between the engine and the project");
+	}
 
-	std::map<std::type_index, void*> entity::component_managers = std::map<std::type_index, void*>();
-	std::map<std::type_index, component_index> ecs_data::component_ids = std::map<std::type_index, component_index>();
-}
\ No newline at end of file
+	ecs_storage::~ecs_storage()
+	{
+		for (archetype* a : archetypes)
+			delete a;
+		for (sparse_pool* p : pools)
+			delete p;
+		for (sparse_group* g : groups)
+			delete g;
+		for (mapped_file* f : snapshots)
+			delete f;
+		delete hierarchy;
+		for (resource_slot& r : resources)
+		{
+			if (r.data)
+				r.destroy(r.data);
+		}
+	}
+
+	archetype* ecs_storage::find_archetype(const ecs_mask& storage, const ecs_mask& mask)
+	{
+		for (archetype* a : archetypes)
+		{
+			if (a->storage == storage && a->mask == mask)
+				return a;
+		}
+
+		archetype* a = new archetype(this, storage, mask, stored_columns(storage), component_infos.size());
+		archetypes.push_back(a);
+		archetype_masks.push_back(mask);
+
+		for (system& s : systems)
+		{
+			if (s.q.matches(a->mask))
+				s.archetypes.push_back(a);
+		}
+
+		return a;
+	}
+
+	std::vector<component_info> ecs_storage::stored_columns(const ecs_mask& storage)
+	{
+		std::vector<component_info> cs;
+		for (uint32_t i = 1; i < component_infos.size(); i++)
+		{
+			if (storage[i] && !component_infos[i].tag)
+				cs.push_back(component_infos[i]);
+		}
+
+		return cs;
+	}
+
+	entity& ecs_storage::create_entity(archetype* a)
+	{
+		return new_entity(a, edit_tick());
+	}
+
+	void ecs_storage::create_entities(archetype* a, uint32_t count, std::vector<entity_handle>& out)
+	{
+		a->reserve(count);
+		if (count > free_entities.size())
+			entities.reserve(entities.size() + count - free_entities.size());
+
+		size_t first = out.size();
+		out.resize(first + count);
+
+		// Filled a chunk at a time rather than going through allocate per entity
+		uint32_t tick = edit_tick();
+		for (uint32_t i = 0; i < count;)
+		{
+			uint32_t ci, row;
+			uint32_t n = a->allocate_run(count - i, tick, ci, row);
+			uint32_t* ids = a->entity_ids(a->chunks[ci]);
+
+			for (uint32_t r = row; r < row + n; r++, i++)
+			{
+				entity& e = take_entity();
+				e.arch = a;
+				e.chunk_index = ci;
+				e.row = r;
+				ids[r] = e.id;
+
+				out[first + i] = e.handle();
+			}
+		}
+
+		// Checked once for the batch rather than per entity
+		bool observed = false;
+		for (observer& o : observers)
+			observed = observed || (o.event == on_add && a->mask[o.component]);
+
+		if (!track_moves && !observed)
+			return;
+
+		for (size_t i = first; i < out.size(); i++)
+		{
+			track_move(out[i].index);
+			if (observed)
+				gained(entities[out[i].index], ecs_mask());
+		}
+	}
+
+	entity& ecs_storage::take_entity()
+	{
+		if (free_entities.empty())
+		{
+			entity e;
+			e.id = entities.size();
+			entities.push_back(std::move(e));
+
+			return entities.back();
+		}
+
+		uint32_t i = free_entities.back();
+		free_entities.pop_back();
+
+		return entities[i];
+	}
+
+	entity& ecs_storage::new_entity(archetype* a, uint32_t tick)
+	{
+		entity& e = take_entity();
+		e.arch = a;
+		a->allocate(e.id, e.chunk_index, e.row);
+		a->mark_all(e.chunk_index, e.row, tick);
+
+		track_move(e.id);
+		gained(e, ecs_mask());
+
+		return e;
+	}
+
+	void ecs_storage::destroy_entity(entity_handle h)
+	{
+		entity* e = get(h);
+		if (!e)
+			return;
+
+		losing(*e, ecs_mask());
+
+		for (sparse_pool* p : pools)
+		{
+			if (p)
+				p->remove(e->id);
+		}
+
+		uint32_t moved = e->arch->remove(e->chunk_index, e->row, true);
+		if (moved != NO_COLUMN)
+		{
+			entities[moved].chunk_index = e->chunk_index;
+			entities[moved].row = e->row;
+			track_move(moved);
+		}
+
+		e->arch = nullptr;
+		e->generation++;
+		free_entities.push_back(e->id);
+		track_move(e->id);
+	}
+
+	void ecs_storage::migrate(entity& e, archetype* to)
+	{
+		archetype* from = e.arch;
+		losing(e, to->mask);
+
+		uint32_t ci, row;
+		to->allocate(e.id, ci, row);
+
+		// New columns count as changed, kept ones keep their tick
+		uint32_t tick = edit_tick();
+		for (component_info& info : to->columns)
+		{
+			if (!from->has(info.id))
+				to->mark(ci, row, info.id, tick);
+		}
+
+		for (component_info& info : from->columns)
+		{
+			if (to->has(info.id))
+			{
+				info.move(to->get(ci, row, info), from->get(e.chunk_index, e.row, info));
+				to->mark(ci, row, info.id, from->ticks(from->chunks[e.chunk_index], info.id)[e.row]);
+			}
+			else
+				info.destroy(from->get(e.chunk_index, e.row, info));
+		}
+
+		uint32_t moved = from->remove(e.chunk_index, e.row, false);
+		if (moved != NO_COLUMN)
+		{
+			entities[moved].chunk_index = e.chunk_index;
+			entities[moved].row = e.row;
+			track_move(moved);
+		}
+
+		e.arch = to;
+		e.chunk_index = ci;
+		e.row = row;
+		track_move(e.id);
+
+		gained(e, from->mask);
+	}
+
+	void ecs_storage::attach(entity& e, component_index id)
+	{
+		ecs_mask storage = e.arch->storage;
+		ecs_mask mask = e.arch->mask;
+		storage.set(id);
+		mask.set(id);
+
+		migrate(e, find_archetype(storage, mask));
+	}
+
+	void ecs_storage::detach(entity& e, component_index id)
+	{
+		ecs_mask storage = e.arch->storage;
+		ecs_mask mask = e.arch->mask;
+		storage.reset(id);
+		mask.reset(id);
+
+		migrate(e, find_archetype(storage, mask));
+	}
+
+	void ecs_storage::set_enabled(entity& e, component_index id, bool enabled)
+	{
+		if (e.arch->mask[id] == enabled)
+			return;
+
+		ecs_mask m = e.arch->mask;
+		if (enabled)
+			m.set(id);
+		else
+			m.reset(id);
+
+		migrate(e, find_archetype(e.arch->storage, m));
+	}
+
+	sparse_group* ecs_storage::create_group(const std::vector<component_index>& ids)
+	{
+		sparse_group* g = new sparse_group();
+		for (component_index id : ids)
+		{
+			if (pools[id]->group)
+			{
+				delete g;
+				throw std::runtime_error("Component is already owned by a group");
+			}
+
+			g->owned.push_back(pools[id]);
+		}
+
+		for (sparse_pool* p : g->owned)
+			p->group = g;
+		groups.push_back(g);
+
+		// Sort in the entities that already have every component
+		std::vector<uint32_t> existing = g->owned[0]->dense;
+		for (uint32_t e : existing)
+			g->enter(e);
+
+		return g;
+	}
+
+	void ecs_storage::create_hierarchy(transform_hierarchy* h)
+	{
+		if (hierarchy)
+		{
+			delete h;
+			throw std::runtime_error("Transforms are already propagated in this world");
+		}
+
+		hierarchy = h;
+	}
+
+	void ecs_storage::match_archetypes(system& s)
+	{
+		s.archetypes.clear();
+
+		std::vector<uint32_t> matched;
+		s.q.match(archetype_masks.data(), archetype_masks.size(), matched);
+
+		for (uint32_t i : matched)
+			s.archetypes.push_back(archetypes[i]);
+	}
+
+	void ecs_storage::build_schedule()
+	{
+		// A system waits for every earlier conflicting system of its stage, so conflicting systems keep their relative order
+		for (int i = 0; i < (int)systems.size(); i++)
+		{
+			systems[i].dependencies = 0;
+			systems[i].dependents.clear();
+
+			for (int j = 0; j < i; j++)
+			{
+				if (systems[i].stage == systems[j].stage && systems[i].conflicts(systems[j]))
+				{
+					systems[i].dependencies++;
+					systems[j].dependents.push_back(i);
+				}
+			}
+		}
+
+		system_tasks.clear();
+		for (int i = 0; i < (int)systems.size(); i++)
+			system_tasks.push_back(system_task{ this, i });
+
+		remaining.reset(new std::atomic<int>[systems.size()]);
+	}
+
+	command_buffer& ecs_storage::commands()
+	{
+		return command_buffers[jobs ? jobs->thread_index() : 0];
+	}
+
+	void ecs_storage::flush()
+	{
+		// Removal observers see every removed component before anything is played back
+		for (observer& o : observers)
+		{
+			if (o.event != on_remove)
+				continue;
+
+			notified.clear();
+			for (command_buffer& b : command_buffers) { for (command* c : b.commands)
+			{
+				bool removes = c->type == command_destroy || ((c->type == command_remove || c->type == command_disable) && c->component == o.component);
+
+				entity* e = removes ? get(c->target) : nullptr;
+				if (e && e->arch->mask[o.component])
+					notified.push_back(e);
+			}}
+
+			dispatch(o, notified);
+		}
+
+		playback.clear();
+		for (command_buffer& b : command_buffers)
+		{
+			for (command* c : b.commands)
+			{
+				c->index = playback.size();
+				playback.push_back(c);
+			}
+		}
+
+		// Entity commands in entity order, then spawns grouped by archetype, schedule order otherwise
+		std::sort(playback.begin(), playback.end(), [](command* c1, command* c2)
+		{
+			bool s1 = c1->type == command_spawn;
+			bool s2 = c2->type == command_spawn;
+
+			if (s1 != s2)
+				return s2;
+			if (!s1 && c1->target.index != c2->target.index)
+				return c1->target.index < c2->target.index;
+			if (s1 && !(c1->mask == c2->mask))
+				return c1->mask < c2->mask;
+			if (c1->sequence != c2->sequence)
+				return c1->sequence < c2->sequence;
+			return c1->index < c2->index;
+		});
+
+		flushing = true;
+
+		for (size_t i = 0; i < playback.size();)
+		{
+			command* c = playback[i];
+			if (c->type != command_spawn)
+			{
+				c->apply(*this, *c, nullptr);
+				i++;
+				continue;
+			}
+
+			size_t end = i + 1;
+			while (end < playback.size() && playback[end]->mask == c->mask)
+				end++;
+
+			archetype* a = find_archetype(c->mask, c->mask);
+			a->reserve((uint32_t)(end - i));
+
+			for (; i < end; i++)
+				playback[i]->apply(*this, *playback[i], a);
+		}
+
+		flushing = false;
+
+		for (command_buffer& b : command_buffers)
+			b.clear(false);
+	}
+
+	void ecs_storage::notify()
+	{
+		for (observer& o : observers)
+		{
+			if (o.event == on_add)
+			{
+				notified.clear();
+				for (entity_handle h : o.pending)
+				{
+					entity* e = get(h);
+					if (e && e->arch->mask[o.component])
+						notified.push_back(e);
+				}
+
+				o.pending.clear();
+				dispatch(o, notified);
+			}
+			else if (o.event == on_change)
+			{
+				// Edits made from here on get a newer tick
+				uint32_t now = next_tick();
+
+				for (archetype* a : archetypes)
+				{
+					if (!a->mask[o.component])
+						continue;
+
+					for (chunk& c : a->chunks)
+					{
+						if (!newer(a->chunk_tick(c, o.component), o.last_run))
+							continue;
+
+						uint32_t* ids = a->entity_ids(c);
+						uint32_t* ticks = a->ticks(c, o.component);
+
+						notified.clear();
+						for (uint32_t i = 0; i < c.count; i++)
+						{
+							if (newer(ticks[i], o.last_run))
+								notified.push_back(&entities[ids[i]]);
+						}
+
+						if (!notified.empty())
+							o.function(span<entity*>(notified.data(), notified.size()), cgo);
+					}
+				}
+
+				o.last_run = now;
+			}
+		}
+	}
+
+	void ecs_storage::gained(entity& e, const ecs_mask& from)
+	{
+		for (observer& o : observers)
+		{
+			if (o.event == on_add && e.arch->mask[o.component] && !from[o.component])
+				o.pending.push_back(e.handle());
+		}
+	}
+
+	void ecs_storage::losing(entity& e, const ecs_mask& to)
+	{
+		if (flushing)
+			return;
+
+		for (observer& o : observers)
+		{
+			if (o.event == on_remove && e.arch->mask[o.component] && !to[o.component])
+			{
+				notified.assign(1, &e);
+				dispatch(o, notified);
+			}
+		}
+	}
+
+	void ecs_storage::dispatch(observer& o, std::vector<entity*>& es)
+	{
+		std::sort(es.begin(), es.end(), [](entity* e1, entity* e2)
+		{
+			if (e1->arch != e2->arch)
+				return e1->arch < e2->arch;
+			if (e1->chunk_index != e2->chunk_index)
+				return e1->chunk_index < e2->chunk_index;
+			return e1->row < e2->row;
+		});
+		es.erase(std::unique(es.begin(), es.end()), es.end());
+
+		for (size_t i = 0; i < es.size();)
+		{
+			size_t end = i + 1;
+			while (end < es.size() && es[end]->arch == es[i]->arch && es[end]->chunk_index == es[i]->chunk_index)
+				end++;
+
+			o.function(span<entity*>(es.data() + i, (uint32_t)(end - i)), cgo);
+			i = end;
+		}
+	}
+
+	void ecs_storage::update(float dt)
+	{
+		begin_frame();
+		update(dt, stage_fixed);
+		update(dt, stage_frame);
+		end_frame();
+	}
+
+	void ecs_storage::update(float dt, system_stage stage)
+	{
+		if (change_tick - tick_floor >= MAX_TICK_AGE + TICK_AGE_INTERVAL)
+			age_ticks();
+
+		if (jobs && command_buffers.size() < (size_t)jobs->size() + 1)
+			command_buffers.resize(jobs->size() + 1);
+
+		bool own_frame = !in_frame;
+		if (own_frame)
+			begin_frame();
+
+		updating = true;
+		if (!jobs)
+		{
+			for (system& s : systems)
+			{
+				if (s.stage == stage)
+					run_system(s, dt);
+			}
+		}
+		else
+		{
+			frame_dt = dt;
+
+			for (int i = 0; i < (int)systems.size(); i++)
+				remaining[i] = systems[i].dependencies;
+
+			for (int i = 0; i < (int)systems.size(); i++)
+			{
+				if (systems[i].stage == stage && systems[i].dependencies == 0)
+					jobs->submit(job{ &ecs_storage::system_job, &system_tasks[i] }, &frame_counter);
+			}
+
+			jobs->wait(frame_counter);
+		}
+		updating = false;
+
+		flush();
+		notify();
+
+		if (own_frame)
+			end_frame();
+	}
+
+	void ecs_storage::begin_frame()
+	{
+		in_frame = true;
+#if ENGINE_PROFILE
+		profile_begin();
+#endif
+	}
+
+	void ecs_storage::end_frame()
+	{
+		in_frame = false;
+#if ENGINE_PROFILE
+		profile_end();
+#endif
+	}
+
+	void ecs_storage::age_ticks()
+	{
+		tick_floor = change_tick - MAX_TICK_AGE;
+
+		for (archetype* a : archetypes)
+			a->age_ticks(tick_floor);
+
+		// Systems that have not run since are one older, so they still see what was aged as changed
+		for (system& s : systems)
+		{
+			if (newer(tick_floor - 1, s.last_run))
+				s.last_run = tick_floor - 1;
+			if (newer(tick_floor - 1, s.this_run))
+				s.this_run = tick_floor - 1;
+		}
+
+		for (observer& o : observers)
+		{
+			if (newer(tick_floor - 1, o.last_run))
+				o.last_run = tick_floor - 1;
+		}
+	}
+
+#if ENGINE_PROFILE
+	void ecs_storage::profile_begin()
+	{
+		frame_start = std::chrono::steady_clock::now();
+
+		// Systems that do not run in the frame are left at zero
+		for (system& s : systems)
+		{
+			s.stats = system_stats();
+			s.stats.function = s.function;
+		}
+
+		busy_start.clear();
+		for (int i = 0; jobs && i <= jobs->size(); i++)
+			busy_start.push_back(jobs->busy(i));
+	}
+
+	void ecs_storage::profile_end()
+	{
+		frame_stats& f = profile.begin_frame();
+		f.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+
+		for (system& s : systems)
+			f.systems.push_back(s.stats);
+
+		if (jobs)
+		{
+			for (int i = 0; i < busy_start.size(); i++)
+				f.busy.push_back((jobs->busy(i) - busy_start[i]) / 1e6);
+		}
+		else
+			f.busy.push_back(f.time);
+
+		profile.end_frame();
+	}
+#endif
+
+	void ecs_storage::run_system(system& s, float dt)
+	{
+		s.last_run = s.this_run;
+		s.this_run = next_tick();
+
+#if ENGINE_PROFILE
+		s.stats.runs++;
+		s.stats.thread = jobs ? jobs->thread_index() : 0;
+#endif
+		ENGINE_PROFILE_SCOPE(s.stats);
+
+		// Another system may already be recording on this thread, one waiting on jobs inside it
+		command_buffer& b = commands();
+		uint64_t sequence = b.next_sequence;
+		b.next_sequence = (uint64_t)(&s - systems.data() + 1) << 32;
+
+		// Systems writing the same pool never run at once
+		for (component_index id : s.written_pools)
+			pools[id]->version++;
+
+		if (s.run_group)
+			s.run_group(s, dt, *this);
+		else if (!s.sparse.empty())
+			run_sparse(s, dt);
+		else
+			run_chunks(s, dt);
+
+		b.next_sequence = sequence;
+	}
+
+	void ecs_storage::run_chunks(system& s, float dt)
+	{
+		for (archetype* a : s.archetypes) { for (chunk& c : a->chunks)
+		{
+			// The chunk tick is the latest of its rows, so unchanged chunks are skipped without looking at them, as is the empty spare
+			bool changed = c.count != 0;
+			for (component_index id : s.changed)
+				changed = changed && newer(a->chunk_tick(c, id), s.last_run);
+
+			if (!changed)
+				continue;
+
+			s.run(s, dt, *a, c, *this);
+			ENGINE_PROFILE_COUNT(s.stats, chunks, 1);
+			ENGINE_PROFILE_COUNT(s.stats, entities, c.count);
+
+			// Batched systems are handed the whole chunk, so all of it counts as written
+			if (s.batched)
+			{
+				for (component_index id : s.written)
+				{
+					// Optional and any_of columns may be missing
+					if (!a->has(id))
+						continue;
+
+					uint32_t* ticks = a->ticks(c, id);
+					std::fill(ticks, ticks + c.count, s.this_run);
+					a->chunk_tick(c, id) = s.this_run;
+				}
+			}
+		}}
+	}
+
+	void ecs_storage::run_sparse(system& s, float dt)
+	{
+		sparse_pool* smallest = pools[s.sparse[0]];
+		for (component_index id : s.sparse)
+		{
+			if (pools[id]->size() < smallest->size())
+				smallest = pools[id];
+		}
+
+		linked_function f = (linked_function)s.function;
+
+		for (uint32_t i = 0; i < smallest->size(); i++)
+		{
+			entity& e = entities[smallest->dense[i]];
+			if (!s.q.matches(e.arch->mask))
+				continue;
+
+			bool matches = true;
+			for (component_index id : s.sparse)
+				matches = matches && pools[id]->has(e.id);
+			for (component_index id : s.changed)
+				matches = matches && newer(e.arch->ticks(e.arch->chunks[e.chunk_index], id)[e.row], s.last_run);
+
+			if (!matches)
+				continue;
+
+			for (component_index id : s.written)
+			{
+				if (e.arch->has(id))
+					e.arch->mark(e.chunk_index, e.row, id, s.this_run);
+			}
+
+			f(dt, e, cgo);
+			ENGINE_PROFILE_COUNT(s.stats, entities, 1);
+		}
+	}
+
+	void ecs_storage::run_entities(const system& s, float dt, archetype& a, chunk& c, ecs_storage& st)
+	{
+		linked_function f = (linked_function)s.function;
+
+		uint32_t* ids = a.entity_ids(c);
+		bool ran = false;
+
+		for (uint32_t i = 0; i < c.count; i++)
+		{
+			bool changed = true;
+			for (component_index id : s.changed)
+				changed = changed && newer(a.ticks(c, id)[i], s.last_run);
+
+			if (!changed)
+				continue;
+
+			for (component_index id : s.written)
+			{
+				if (a.has(id))
+					a.ticks(c, id)[i] = s.this_run;
+			}
+
+			f(dt, st.entities[ids[i]], st.cgo);
+			ran = true;
+		}
+
+		if (ran)
+		{
+			for (component_index id : s.written)
+			{
+				if (a.has(id))
+					a.chunk_tick(c, id) = s.this_run;
+			}
+		}
+	}
+
+	void ecs_storage::system_job(void* data)
+	{
+		system_task* t = (system_task*)data;
+		ecs_storage* st = t->storage;
+		system& s = st->systems[t->index];
+
+		st->run_system(s, st->frame_dt);
+
+		for (int d : s.dependents)
+		{
+			if (--st->remaining[d] == 0)
+				st->jobs->submit(job{ &ecs_storage::system_job, &st->system_tasks[d] }, &st->frame_counter);
+		}
+	}
+}
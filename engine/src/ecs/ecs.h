@@ -3,9 +3,20 @@
 #include "pch.h"
 
 #include "maths/types/vector3.h"
+#include "maths/types/matrix4.h"
 
 #include "graphics/renderer.h"
 
+#include "ecs/mask.h"
+#include "ecs/archetype.h"
+#include "ecs/span.h"
+#include "ecs/sparse_set.h"
+#include "ecs/query.h"
+#include "ecs/shared.h"
+#include "ecs/profiler.h"
+
+#include "jobs/job_system.h"
+
 namespace engine
 {
 	struct core_game_objects
@@ -16,153 +27,447 @@ namespace engine
 		core_game_objects(renderer* rp, window* wp) : r(rp), w(wp) {}
 	};
 
-	typedef uint16_t component_index;
-
-	extern int id_counter;
-	const int NO_COMPONENTS = 3;
-	const int NO_COMPONENT_IS = (NO_COMPONENTS - (NO_COMPONENTS % 64)) / 64 + 1;
-
 	template<class... Ts>
 	struct ecs_manager;
 
-	struct base {};
+	template<typename T, typename... Ts>
+	struct index_of;
 
-	enum ecs_types
+	template<typename T, typename... Ts>
+	struct index_of<T, T, Ts...> : std::integral_constant<component_index, 0> {};
+
+	template<typename T, typename U, typename... Ts>
+	struct index_of<T, U, Ts...> : std::integral_constant<component_index, 1 + index_of<T, Ts...>::value> {};
+
+	// Filled in by ecs_manager from its type list, 0 means T is not a registered component
+	// There is one id per type rather than per world, so every ecs_manager listing T has to list it at the same position
+	template<typename T>
+	struct component_type
 	{
-		ecs_entity,
-		ecs_component,
-		ecs_system,
+		static inline component_index id = 0;
 	};
 
-	class ecs_mask
+	inline uint32_t next_resource_id()
 	{
-	public:
-		uint64_t mask[NO_COMPONENT_IS];
+		static std::atomic<uint32_t> next{ 0 };
+		return next++;
+	}
 
-		ecs_mask()
-		{
-			std::fill_n(mask, NO_COMPONENT_IS, 0);
+	// Resource ids are handed out once per type, so every world agrees on them
+	template<typename T>
+	struct resource_type
+	{
+		static inline const uint32_t id = next_resource_id();
+	};
 
-			uint64_t* start = &mask[0];
+	// Stays valid across the entity moving chunk, and goes stale once the entity is destroyed and its slot reused
+	struct entity_handle
+	{
+		uint32_t index = NO_ENTITY;
+		uint32_t generation = 0;
 
-			for (int i = 0; i < NO_COMPONENT_IS; i++)
-			{
-				*start = 0;
-				start++;
-			}
-		}
+		bool operator==(const entity_handle& h) const { return index == h.index && generation == h.generation; }
+		bool operator!=(const entity_handle& h) const { return !(*this == h); }
+	};
 
-		void set(int i)
-		{
-			int offset = i % 64;
-			int v_index = (i - offset) / 64;
-			mask[v_index] = mask[v_index] | ((uint64_t)1 << offset);
-		}
+	struct entity
+	{
+		uint32_t id;
+		uint32_t generation = 0;
 
-		void reset(int i)
-		{
-			int offset = i % 64;
-			int v_index = (i - offset) / 64;
+		archetype* arch;
+		uint32_t chunk_index;
+		uint32_t row;
 
-			mask[v_index] = mask[v_index] ^ ((uint64_t)1 << offset);
-		}
+		// Entities are only ever handed out by reference, copies would go stale as soon as the entity moves chunk
+		entity() = default;
+		entity(const entity&) = delete;
+		entity& operator=(const entity&) = delete;
+		entity(entity&&) = default;
+		entity& operator=(entity&&) = default;
+
+		const ecs_mask& mask() const { return arch->mask; }
+		bool alive() const { return arch != nullptr; }
+
+		entity_handle handle() const { return entity_handle{ id, generation }; }
+		ecs_storage& world() { return *arch->owner; }
+
+		// Archetype references stay valid as the archetype grows, until the entity moves, which includes the archetype's last entity filling the row of one that left
+		// Sparse references stay valid as the pool grows, until any entity's component is removed from the pool (the last entry fills its place)
+		// or, for pools owned by a group, an entity enters or leaves the group, which reorders them. Look components up again after either
+		template<typename T>
+		T& get();
+		template<typename T>
+		bool has();
+		// get does not track writes, systems mark the components they write and anything else writing outside of one calls this
+		template<typename T>
+		void mark_changed();
+
+		// Structural changes, archetype components move the entity to another archetype
+		template<typename T>
+		T& add(T c);
+		template<typename T>
+		void remove();
+
+		template<typename T>
+		void enable();
+		template<typename T>
+		void disable();
+	};
+
+	class ecs_storage;
+	class command_buffer;
+	class mapped_file;
+	class transform_hierarchy;
+	struct command;
+	struct system;
+
+	typedef void (*linked_function)(float dt, entity&, core_game_objects*);
+	// Batched form, called once per chunk with a span for each listed component and a reference for each resource
+	template<typename T>
+	struct argument_type
+	{
+		typedef span<typename column_type<T>::type> type;
+	};
+	template<typename T>
+	struct argument_type<res<T>>
+	{
+		typedef T& type;
+	};
+
+	template<typename L>
+	struct batch_function_type;
+	template<typename... ts>
+	struct batch_function_type<type_list<ts...>>
+	{
+		typedef void (*type)(float dt, typename argument_type<ts>::type..., core_game_objects*);
+	};
+	template<typename... ts>
+	using batch_function = typename batch_function_type<data_list<ts...>>::type;
+
+	// Every system form is run through one of these, once per matching chunk
+	typedef void (*chunk_function)(const system& s, float dt, archetype& a, chunk& c, ecs_storage& st);
+
+	enum system_stage
+	{
+		stage_fixed, // Steps the simulation, run by fixed_scheduler at a fixed rate
+		stage_frame, // Runs once per rendered frame, for input and render state
+	};
+
+	struct system
+	{
+		query q;
+		ecs_mask reads;
+		ecs_mask writes;
+		std::vector<archetype*> archetypes; // Matching archetypes, kept up to date as archetypes are created
+		std::vector<component_index> sparse; // Required sparse components, these are not part of the query
+		std::vector<component_index> written; // Archetype components in writes, their ticks are marked as the system runs
+		std::vector<component_index> written_pools; // Sparse components in writes, their pools' versions are bumped as the system runs
+		std::vector<component_index> changed; // changed<T> terms
+		std::vector<uint32_t> resource_reads; // Resource ids
+		std::vector<uint32_t> resource_writes;
+
+		bool batched = false;
+		system_stage stage = stage_fixed;
+		uint32_t last_run = 0; // Change tick of the previous run, anything marked after it counts as changed
+		uint32_t this_run = 0;
+
+		chunk_function run;
+		// Systems that run once per update instead, batched systems over an owning group and transform propagation
+		void (*run_group)(const system& s, float dt, ecs_storage& st) = nullptr;
+		void (*function)(); // The linked_function or batch_function, cast back by run
+		int order;
+
+#if ENGINE_PROFILE
+		mutable system_stats stats; // Of the current frame, reset as it begins
+#endif
+
+		// Filled in by ecs_storage::build_schedule, indices into ecs_storage::systems
+		int dependencies = 0;
+		std::vector<int> dependents;
+
+		system(int o, chunk_function r, void (*f)()) : run(r), function(f), order(o) {}
+
+		system(const system&) = delete;
+		system& operator=(const system&) = delete;
+		system(system&&) = default;
+		system& operator=(system&&) = default;
 
-		inline bool operator|(ecs_mask& m)
+		// Two systems conflict if either writes a component or resource the other one uses
+		bool conflicts(const system& s) const
 		{
-			for (int i = 0; i < NO_COMPONENT_IS; i++)
-			{
-				if (!(mask[i] | m.mask[i]))
-					return false;
-			}
-			return true;
+			return writes.intersects(s.reads | s.writes) || s.writes.intersects(reads)
+				|| overlap(resource_writes, s.resource_reads) || overlap(resource_writes, s.resource_writes) || overlap(s.resource_writes, resource_reads);
 		}
-		inline bool operator&(ecs_mask& m)
+
+		static bool overlap(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
 		{
-			for (int i = 0; i < NO_COMPONENT_IS; i++)
+			for (uint32_t i : a)
 			{
-				if (!(mask[i] & m.mask[i]))
-					return false;
+				if (std::find(b.begin(), b.end(), i) != b.end())
+					return true;
 			}
-			return true;
-		}
-		inline bool operator[](int i)
-		{
-			int offset = i % 64;
-			int v_index = (i - offset) / 64;
 
-			return mask[v_index] & ((uint64_t)1 << offset);
+			return false;
 		}
 	};
 
-	struct ecs_data
+	enum observer_event
 	{
-		static std::map<std::type_index, component_index> component_ids;
+		on_add, // The component was added or enabled, including by spawning the entity
+		on_remove, // The component is about to be removed, disabled or destroyed with the entity, it can still be read
+		on_change, // The component's change tick moved, which includes it being added
 	};
 
-	struct entity
+	// Called once per chunk with the entities the event happened to
+	typedef void (*observer_function)(span<entity*> entities, core_game_objects* cgo);
+
+	struct observer
+	{
+		observer_event event;
+		component_index component;
+		observer_function function;
+
+		std::vector<entity_handle> pending; // on_add, entities that gained the component since the last notify
+		uint32_t last_run = 0; // on_change
+	};
+
+	// How far behind change_tick ticks are allowed to fall, and how often update raises the ones that have
+	const uint32_t MAX_TICK_AGE = 1u << 30;
+	const uint32_t TICK_AGE_INTERVAL = 1u << 28;
+
+	struct resource_slot
 	{
-		static std::map<std::type_index, void*> component_managers;
+		void* data = nullptr;
+		void (*destroy)(void* p) = nullptr;
+	};
+
+	// Type erased archetype and entity bookkeeping shared by every ecs_manager
+	class ecs_storage
+	{
+	public:
+		core_game_objects* cgo = nullptr;
+		// Systems run serially on the calling thread when not set
+		job_system* jobs = nullptr;
+		// Set while update runs systems
+		bool updating = false;
+
+		std::vector<entity> entities; // Indexed by entity_handle::index, destroyed slots are reused through free_entities
+		std::vector<uint32_t> free_entities;
+		std::vector<archetype*> archetypes;
+		std::vector<ecs_mask> archetype_masks; // The enabled mask of each archetype, packed for query::match
+		std::vector<component_info> component_infos; // Indexed by component id, 0 is unused
+		std::vector<sparse_pool*> pools; // Indexed by component id, nullptr for archetype components
+		std::vector<sparse_group*> groups;
+		std::vector<system> systems;
+		// Observers run on the calling thread outside of systems, structural changes made from them go through commands()
+		std::vector<observer> observers;
+		transform_hierarchy* hierarchy = nullptr;
+		// World-wide values that belong to no entity, indexed by resource_type<T>::id
+		std::vector<resource_slot> resources;
+
+#if ENGINE_PROFILE
+		profiler profile;
+#endif
+
+		// Bumped by every system run, changes made outside of systems use edit_tick instead
+		std::atomic<uint32_t> change_tick{ 0 };
+		uint32_t next_tick() { return ++change_tick; }
+		// Newer than every system run so far, without using up a tick per spawn, move or mark
+		uint32_t edit_tick() const { return change_tick + 1; }
+
+		// Every tick the world holds is at least this, update raises older ones long before wrapping would make them look new
+		uint32_t tick_floor = 0u - MAX_TICK_AGE;
+		void age_ticks();
+
+		// Entities whose slot changed since the last rollback capture, only kept while track_moves is set
+		bool track_moves = false;
+		std::vector<uint32_t> moved_entities;
+		void track_move(uint32_t e) { if (track_moves) moved_entities.push_back(e); }
+
+		// mask_words and profiled are NO_COMPONENT_IS and ENGINE_PROFILE as seen by the project, checked against the engine's
+		ecs_storage(int mask_words, int profiled);
+		~ecs_storage();
+
+		ecs_storage(const ecs_storage&) = delete;
+		ecs_storage& operator=(const ecs_storage&) = delete;
+
+		archetype* find_archetype(const ecs_mask& storage, const ecs_mask& mask);
+		// The columns an archetype storing these components has, in id order
+		std::vector<component_info> stored_columns(const ecs_mask& storage);
+
+		entity& create_entity(archetype* a);
+		// Reserves room for every entity up front, component data is left unconstructed as with create_entity
+		void create_entities(archetype* a, uint32_t count, std::vector<entity_handle>& out);
+		void destroy_entity(entity_handle h);
+
+		// nullptr if the entity has been destroyed
+		entity* get(entity_handle h)
+		{
+			if (h.index >= entities.size())
+				return nullptr;
+
+			entity& e = entities[h.index];
+			return e.generation == h.generation && e.alive() ? &e : nullptr;
+		}
+		bool alive(entity_handle h) { return get(h) != nullptr; }
+		// Moves an entity into another archetype, columns missing from the new archetype are destroyed and new ones are left unconstructed
+		void migrate(entity& e, archetype* to);
 
-		ecs_mask mask;
-		std::map<std::type_index, component_index> component_ids;
+		// Moves the entity to the archetype with the component added (stored and enabled) or removed
+		void attach(entity& e, component_index id);
+		void detach(entity& e, component_index id);
+		void set_enabled(entity& e, component_index id, bool enabled);
 
 		template<typename T>
-		T& get();
+		sparse_set<std::remove_const_t<T>>& pool() { return *(sparse_set<std::remove_const_t<T>>*)pools[component_type<std::remove_const_t<T>>::id]; }
 
+		// Resources are added and removed outside of update, systems list res<T> to use them
 		template<typename T>
-		void enable();
+		T& add_resource(T value)
+		{
+			uint32_t id = resource_type<T>::id;
+			if (id >= resources.size())
+				resources.resize(id + 1);
+
+			resource_slot& r = resources[id];
+			if (r.data)
+				r.destroy(r.data);
+
+			r.data = new T(std::move(value));
+			r.destroy = [](void* p) { delete (T*)p; };
+
+			return *(T*)r.data;
+		}
+
 		template<typename T>
-		void disable();
-	};
+		void remove_resource()
+		{
+			if (!has_resource<T>())
+				return;
 
-	struct component{};
+			resource_slot& r = resources[resource_type<T>::id];
+			r.destroy(r.data);
+			r = resource_slot();
+		}
 
-	template<class T>
-	struct component_manager
-	{
-		int component_id;
+		template<typename T>
+		bool has_resource()
+		{
+			uint32_t id = resource_type<std::remove_const_t<T>>::id;
+			return id < resources.size() && resources[id].data;
+		}
 
-		std::vector<T> components;
+		template<typename T>
+		T& resource()
+		{
+			if (!has_resource<T>())
+				throw std::runtime_error(std::string("Missing resource ") + typeid(T).name());
 
-		component_manager() : component_id(id_counter) { id_counter++; }
-	};
+			return *(T*)resources[resource_type<std::remove_const_t<T>>::id].data;
+		}
 
-	typedef void (*linked_function)(float dt, entity&, core_game_objects*);
+		// Shared components for equal values point at the same copy, kept in the world's shared_table<T> resource
+		// The table is not locked, so values are shared outside of update and handed to systems already shared
+		template<typename T>
+		shared<T> share(const T& value)
+		{
+			if (updating)
+				throw std::runtime_error("Values cannot be shared while systems are running");
+			if (!has_resource<shared_table<T>>())
+				add_resource(shared_table<T>());
 
-	struct system
-	{
-		ecs_mask mask;
+			return shared<T>{ resource<shared_table<T>>().intern(value) };
+		}
 
-		linked_function function;
-		int order;
+		// A pool can only be owned by one group
+		sparse_group* create_group(const std::vector<component_index>& ids);
+		// A world has at most one hierarchy, which it then owns
+		void create_hierarchy(transform_hierarchy* h);
+
+		void match_archetypes(system& s);
+		void build_schedule();
+
+		// Structural changes made directly while update is running invalidate the iteration, record them here instead
+		command_buffer& commands();
+		// Plays back every thread's commands, sorted by entity, with spawns batched per archetype
+		void flush();
+
+		// Runs on_add and on_change observers, on_remove ones run as the component goes
+		void notify();
+
+		// Writes every entity to a versioned binary snapshot, components have to be trivially copyable and not shared<T>
+		void save(const std::string& path);
+		// Maps a snapshot into an empty world, its chunks are used in place
+		void load(const std::string& path);
+
+		// Runs every system, the fixed stage then the frame stage
+		void update(float dt);
+		// Runs the systems of one stage, then plays back commands and notifies observers
+		void update(float dt, system_stage stage);
+		// Bracket every update of a frame so the profiler records it once, however many fixed steps it ran
+		// update(dt) and fixed_scheduler call these, a stage updated outside of them is recorded as a frame of its own
+		void begin_frame();
+		void end_frame();
+		void run_system(system& s, float dt);
+		void run_chunks(system& s, float dt);
+		// Per-entity systems with sparse components walk the smallest of their pools instead of archetypes
+		void run_sparse(system& s, float dt);
+
+		static void run_entities(const system& s, float dt, archetype& a, chunk& c, ecs_storage& st);
+
+	private:
+		struct system_task
+		{
+			ecs_storage* storage;
+			int index;
+		};
 
-		system(int o, linked_function lf) : order(o), function(lf) {}
+		std::vector<command_buffer> command_buffers; // One per job system thread
+		std::vector<command*> playback;
+
+		std::vector<system_task> system_tasks;
+		std::unique_ptr<std::atomic<int>[]> remaining;
+		job_counter frame_counter{ 0 };
+		float frame_dt = 0;
+
+		std::vector<mapped_file*> snapshots; // Mapped by load, outlive the archetypes whose chunks point into them
+
+#if ENGINE_PROFILE
+		std::chrono::steady_clock::time_point frame_start;
+		std::vector<uint64_t> busy_start;
+
+		void profile_begin();
+		void profile_end();
+#endif
+
+		bool in_frame = false; // Between begin_frame and end_frame
+		bool flushing = false; // on_remove observers have already been run for the commands being played back
+		std::vector<entity*> notified;
+
+		entity& new_entity(archetype* a, uint32_t tick);
+		// A fresh or reused entity slot, not yet placed in an archetype
+		entity& take_entity();
+
+		void gained(entity& e, const ecs_mask& from);
+		void losing(entity& e, const ecs_mask& to);
+		// Sorts the entities by chunk and calls the observer once per chunk
+		void dispatch(observer& o, std::vector<entity*>& es);
+
+		static void system_job(void* data);
 	};
 
 	template<class... Ts>
-	class ecs_manager
+	class ecs_manager : public ecs_storage
 	{
 	public:
-		core_game_objects* cgo;
+		static_assert(sizeof...(Ts) + 1 <= NO_COMPONENTS, "More components than ENGINE_MAX_COMPONENTS");
 
-		std::vector<entity> entities;
-		std::tuple<component_manager<Ts>...> components_tuple;
-		std::vector<component_manager<component>*> components;
-		std::vector<system> systems;
+		template<typename T>
+		static constexpr component_index id = index_of<std::remove_const_t<T>, Ts...>::value + 1;
 
-		void update(float dt)
+		ecs_manager() : ecs_storage(NO_COMPONENT_IS, ENGINE_PROFILE)
 		{
-			for (system s : systems) { for (entity e : entities)
-			{
-				//std::cout << "System: " << s.mask.mask[0] << std::endl << "Entity: " << e.mask.mask[0] << std::endl << std::endl;
-				if (s.mask | e.mask)
-					s.function(dt, e, cgo);
-			}}
-		}
-		
-		ecs_manager() : components_tuple{component_manager<Ts>{}...}
-		{
-			components.push_back(nullptr);
 			constructor_helper<0, Ts...>();
 		}
 
@@ -171,10 +476,18 @@ namespace engine
 		{
 			const int i = I;
 
-			component_manager<t>* cm = &std::get<i>(components_tuple);
-			components.push_back((component_manager<component>*)cm);
-			entity::component_managers[typeid(t)] = &std::get<i>(components_tuple);
-			ecs_data::component_ids[typeid(t)] = i + 1;
+			static_assert(!(is_tag<t> && is_sparse<t>), "Empty components are tags kept in the archetype mask, they cannot be sparse");
+
+			if (component_type<t>::id != 0 && component_type<t>::id != id<t>)
+				throw std::runtime_error(std::string("Component ") + typeid(t).name() + " is listed at a different position by another ecs_manager");
+
+			component_infos.push_back(component_info::of<t>(id<t>));
+			component_type<t>::id = id<t>;
+
+			if constexpr (is_sparse<t>)
+				pools.push_back(new sparse_set<t>());
+			else
+				pools.push_back(nullptr);
 
 			constructor_helper<i + 1, ts...>();
 		}
@@ -185,69 +498,385 @@ namespace engine
 		template<typename... ts>
 		entity& add_entity(ts... data)
 		{
-			entities.push_back(entity());
+			ecs_mask m;
+			mask_helper<0, ts...>(m);
+
+			entity& e = create_entity(find_archetype(m, m));
+
+			add_entity_helper<0, ts...>(e, data...);
+
+			return e;
+		}
+
+		// Spawns count entities with default constructed components, then calls init(i, components...) on the i-th one
+		template<typename... ts, typename F>
+		std::vector<entity_handle> spawn_n(uint32_t count, F init)
+		{
+			ecs_mask m;
+			mask_helper<0, ts...>(m);
+
+			archetype* a = find_archetype(m, m);
+			uint32_t start = a->count;
+
+			std::vector<entity_handle> hs;
+			create_entities(a, count, hs);
+
+			// The new entities are the archetype's last count rows, in order, so columns are walked a chunk at a time
+			for (uint32_t i = 0; i < count;)
+			{
+				chunk& c = a->chunks[(start + i) / a->capacity];
+				uint32_t row = (start + i) % a->capacity;
+				uint32_t end = std::min(c.count, row + count - i);
+				uint32_t* ids = a->entity_ids(c);
+
+				// Adding a sparse component can reorder the pools of an owning group, so references are only taken once every component is in
+				for (; row < end; row++, i++)
+				{
+					(spawn_helper<ts>(*a, c, row, ids[row]), ...);
+					init(i, spawned_helper<ts>(*a, c, row, ids[row])...);
+				}
+			}
+
+			return hs;
+		}
+
+		template<typename t>
+		void spawn_helper(archetype& a, chunk& c, uint32_t row, uint32_t e)
+		{
+			if constexpr (is_sparse<t>)
+				pool<t>().add(e, t());
+			else if constexpr (!is_tag<t>)
+				new (a.column<t>(c, id<t>) + row) t();
+		}
+
+		template<typename t>
+		t& spawned_helper(archetype& a, chunk& c, uint32_t row, uint32_t e)
+		{
+			if constexpr (is_sparse<t>)
+				return pool<t>().get(e);
+			else if constexpr (is_tag<t>)
+				return entities[e].get<t>();
+			else
+				return a.column<t>(c, id<t>)[row];
+		}
 
-			add_entity_helper<0, ts...>(data...);
+		template<int I, typename t, typename... ts>
+		void mask_helper(ecs_mask& m)
+		{
+			if constexpr (!is_sparse<t>)
+				m.set(id<t>);
 
-			return entities[entities.size() - 1];
+			mask_helper<I, ts...>(m);
 		}
 
+		template<int I>
+		void mask_helper(ecs_mask& m) {}
+
 		template<int I, typename t, typename... ts>
-		void add_entity_helper(t c, ts... data)
+		void add_entity_helper(entity& e, t c, ts... data)
 		{
-			t comp = c;
-			((component_manager<t>*)components[ecs_data::component_ids[typeid(t)]])->components.push_back(comp);
-			entities[entities.size()-1].component_ids[typeid(t)] = (components[ecs_data::component_ids[typeid(t)]]->components.size()) / sizeof(t);
-			entities[entities.size()-1].enable<t>();
-			add_entity_helper<I, ts...>(data...);
+			if constexpr (is_sparse<t>)
+				pool<t>().add(e.id, std::move(c));
+			else if constexpr (!is_tag<t>)
+				new (&e.get<t>()) t(std::move(c));
+
+			add_entity_helper<I, ts...>(e, data...);
 		}
 
 		template<int I>
-		void add_entity_helper() {}
+		void add_entity_helper(entity& e) {}
+
+		template<typename T>
+		void add_observer(observer_event ev, observer_function f)
+		{
+			static_assert(!is_sparse<T>, "Sparse components are not observed");
+			if (is_tag<T> && ev == on_change)
+				throw std::runtime_error("Tags have no change ticks, only on_add and on_remove are observed");
 
+			observer o;
+			o.event = ev;
+			o.component = id<T>;
+			o.function = f;
+			o.last_run = next_tick();
+
+			observers.push_back(std::move(o));
+		}
+
+		// Components listed as const are only read by the system, which lets it run alongside other readers
 		template<typename... ts>
-		void add_system(int o, linked_function lf)
+		void add_system(int o, linked_function lf, system_stage stage = stage_fixed)
 		{
-			systems.push_back(system(o, lf));
+			systems.push_back(system(o, &ecs_storage::run_entities, (void (*)())lf));
+			systems.back().stage = stage;
 			add_system_helper<0, ts...>(systems.size()-1);
 		}
 
+		// Groups have to exist before the batched systems that use them are added
+		template<typename... ts>
+		sparse_group& add_group()
+		{
+			static_assert((is_sparse<ts> && ...), "Archetype components are already packed per chunk, only sparse components are grouped");
+
+			return *create_group({ id<ts>... });
+		}
+
+		// Adds the system computing world_transform from T and the parent's world_transform, parent and world_transform have to be listed components
+		// Defined in hierarchy.h
+		template<typename T>
+		void add_transform_propagation(int o, matrix4 (*local)(const T&));
+
+		template<typename... ts>
+		void add_system(int o, batch_function<ts...> bf, system_stage stage = stage_fixed)
+		{
+			if constexpr ((is_sparse<typename column_type<ts>::type> || ...))
+			{
+				static_assert((is_sparse<ts> && ...), "Sparse components are not contiguous unless they are all owned by one group");
+
+				// The group's members are the entities with every pool it owns, so it has to own exactly the listed ones
+				component_index ids[] = { id<ts>... };
+				sparse_group* g = pools[ids[0]]->group;
+				for (component_index i : ids)
+				{
+					if (!g || pools[i]->group != g)
+						throw std::runtime_error("Batched systems over sparse components need a group owning all of them");
+				}
+				if (g->owned.size() != sizeof...(ts))
+					throw std::runtime_error("Batched systems over sparse components need a group owning only them");
+
+				systems.push_back(system(o, nullptr, (void (*)())bf));
+				systems.back().run_group = &ecs_manager::run_grouped<ts...>;
+			}
+			else
+				systems.push_back(system(o, &ecs_manager::run_batch<data_list<ts...>>, (void (*)())bf));
+
+			systems.back().batched = true;
+			systems.back().stage = stage;
+			add_system_helper<0, ts...>(systems.size()-1);
+		}
+
+		template<typename L>
+		static void run_batch(const system& s, float dt, archetype& a, chunk& c, ecs_storage& st)
+		{
+			call_batch(L(), s, dt, a, c, st);
+		}
+
+		template<typename... ts>
+		static void call_batch(type_list<ts...>, const system& s, float dt, archetype& a, chunk& c, ecs_storage& st)
+		{
+			((typename batch_function_type<type_list<ts...>>::type)s.function)(dt, argument<ts>(a, c, st)..., st.cgo);
+		}
+
+		template<typename t>
+		static typename argument_type<t>::type argument(archetype& a, chunk& c, ecs_storage& st)
+		{
+			if constexpr (term_traits<t>::kind == term_resource)
+				return st.resource<typename term_traits<t>::component>();
+			else
+				return column_span<t>(a, c);
+		}
+
+		// The group members are the first entries of every owned pool, in the same order
+		// Pools page at the same element count, so the function is called once per page
+		template<typename... ts>
+		static void run_grouped(const system& s, float dt, ecs_storage& st)
+		{
+			uint32_t size = st.pools[s.sparse[0]]->group->size;
+			ENGINE_PROFILE_COUNT(s.stats, entities, size);
+
+			for (uint32_t start = 0; start < size; start += DEFAULT_PAGE_SIZE)
+			{
+				uint32_t n = std::min(size - start, DEFAULT_PAGE_SIZE);
+				((batch_function<ts...>)s.function)(dt, span<ts>(&st.pool<ts>().data[start], n)..., st.cgo);
+			}
+		}
+
+		template<typename t>
+		static span<typename column_type<t>::type> column_span(archetype& a, chunk& c)
+		{
+			typedef typename column_type<t>::type T;
+
+			if constexpr (term_traits<t>::kind == term_optional)
+			{
+				if (!a.mask[id<T>])
+					return span<T>(nullptr, 0);
+			}
+
+			return span<T>(a.column<T>(c, id<T>), c.count);
+		}
+
 		template<int I, typename t, typename... ts>
 		void add_system_helper(int i)
 		{
-			systems[i].mask.set(ecs_data::component_ids[typeid(t)]);
+			system& s = systems[i];
+
+			if constexpr (term_traits<t>::kind == term_changed)
+			{
+				typedef typename term_traits<t>::component c;
+				static_assert(!is_sparse<c> && !is_tag<c>, "Change ticks are only kept for archetype components with data");
+
+				s.q.all.set(id<c>);
+				s.reads.set(id<c>);
+				s.changed.push_back(id<c>);
+			}
+			else if constexpr (term_traits<t>::kind == term_without)
+			{
+				typedef typename term_traits<t>::component c;
+				static_assert(!is_sparse<c>, "Sparse components are not part of the archetype mask");
+
+				s.q.none.set(id<c>);
+			}
+			else if constexpr (term_traits<t>::kind == term_any)
+				any_helper(s, (t*)nullptr);
+			else if constexpr (term_traits<t>::kind == term_optional)
+				access_helper<typename term_traits<t>::component>(s);
+			else if constexpr (term_traits<t>::kind == term_resource)
+				resource_helper<typename term_traits<t>::component>(s);
+			else
+			{
+				if constexpr (is_sparse<t>)
+					s.sparse.push_back(id<t>);
+				else
+					s.q.all.set(id<t>);
+
+				access_helper<t>(s);
+			}
 
 			add_system_helper<0, ts...>(i);
 		}
 
+		template<typename... ts>
+		void any_helper(system& s, any_of<ts...>*)
+		{
+			static_assert(!(is_sparse<ts> || ...), "Sparse components are not part of the archetype mask");
+
+			(s.q.any.set(id<ts>), ...);
+			(access_helper<ts>(s), ...);
+		}
+
+		template<typename t>
+		void access_helper(system& s)
+		{
+			// Tags cannot be written to, only added and removed
+			if constexpr (std::is_const_v<t> || is_tag<t>)
+				s.reads.set(id<t>);
+			else
+			{
+				s.writes.set(id<t>);
+				if constexpr (is_sparse<t>)
+					s.written_pools.push_back(id<t>);
+				else
+					s.written.push_back(id<t>);
+			}
+		}
+
+		template<typename t>
+		void resource_helper(system& s)
+		{
+			if constexpr (std::is_const_v<t>)
+				s.resource_reads.push_back(resource_type<std::remove_const_t<t>>::id);
+			else
+				s.resource_writes.push_back(resource_type<t>::id);
+		}
+
 		template<int I>
 		void add_system_helper(int i)
 		{
+			// Everything in the world counts as changed on the first run
+			systems[i].this_run = tick_floor - 1;
+			match_archetypes(systems[i]);
+
 			std::sort(systems.begin(), systems.end(), [](system& s1, system& s2) { return s1.order > s2.order; });
+			build_schedule();
 		}
 	};
 
 	template<typename T>
 	T& entity::get()
 	{
-		component_manager<T>& cm = *((component_manager<T>*)component_managers[typeid(T)]);
-		return ((component_manager<T>*)component_managers[typeid(T)])->components[component_ids[typeid(T)]-1];
+		if constexpr (is_tag<T>)
+		{
+			// Tags hold nothing, so every entity shares one
+			static std::remove_const_t<T> t;
+			return t;
+		}
+		else if constexpr (is_sparse<T>)
+			return arch->owner->pool<T>().get(id);
+		else
+			return arch->column<T>(arch->chunks[chunk_index], component_type<T>::id)[row];
+	}
+
+	template<typename T>
+	bool entity::has()
+	{
+		if constexpr (is_sparse<T>)
+			return arch->owner->pool<T>().has(id);
+		else
+			return arch->storage[component_type<T>::id];
+	}
+
+	template<typename T>
+	void entity::mark_changed()
+	{
+		static_assert(!is_tag<T>, "Change ticks are only kept for components with data");
+
+		// Sparse components only keep a version per pool
+		if constexpr (is_sparse<T>)
+			arch->owner->pool<T>().version++;
+		else
+			arch->mark(chunk_index, row, component_type<T>::id, arch->owner->edit_tick());
+	}
+
+	template<typename T>
+	T& entity::add(T c)
+	{
+		if constexpr (is_sparse<T>)
+			return arch->owner->pool<T>().add(id, std::move(c));
+		else if constexpr (is_tag<T>)
+		{
+			if (!has<T>())
+				arch->owner->attach(*this, component_type<T>::id);
+			return get<T>();
+		}
+		else
+		{
+			if (has<T>())
+			{
+				mark_changed<T>();
+				return get<T>() = std::move(c);
+			}
+
+			arch->owner->attach(*this, component_type<T>::id);
+			return *new (&get<T>()) T(std::move(c));
+		}
+	}
+
+	template<typename T>
+	void entity::remove()
+	{
+		if constexpr (is_sparse<T>)
+			arch->owner->pool<T>().remove(id);
+		else if (has<T>())
+			arch->owner->detach(*this, component_type<T>::id);
 	}
 
 	template<typename T>
 	void entity::enable()
 	{
-		if (component_ids.count(typeid(T)))
-			mask.set(ecs_data::component_ids[typeid(T)]);
+		component_index id = component_type<T>::id;
+
+		if (!is_sparse<T> && arch->storage[id])
+			arch->owner->set_enabled(*this, id, true);
 		else
 			std::cout << "Error: Failed to attach " << typeid(T).name() << std::endl;
 	}
 	template<typename T>
 	void entity::disable()
 	{
-		if (!component_ids.count(typeid(T)))
-			mask.reset(ecs_data::component_ids[typeid(T)]);
+		component_index id = component_type<T>::id;
+
+		if (!is_sparse<T> && arch->storage[id])
+			arch->owner->set_enabled(*this, id, false);
 		else
 			std::cout << "Error: Failed to detach " << typeid(T).name() << std::endl;
 	}
-}
\ No newline at end of file
+}
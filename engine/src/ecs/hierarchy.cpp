@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "hierarchy.h"
+
+namespace engine
+{
+	static const uint32_t VISITING = NO_ENTITY - 1; // In depths, while the entity's chain is being placed
+	static const uint32_t NOT_PLACED = NO_ENTITY - 1; // In parents, for entities that are not nodes
+
+	void transform_hierarchy::run(const system& s, float dt, ecs_storage& st)
+	{
+		transform_hierarchy& h = *st.hierarchy;
+
+		// Any node being spawned, destroyed or reparented rebuilds the levels, only nodes placed under another parent are then recomputed
+		bool rebuilt = !h.built || h.changed(s);
+		if (rebuilt)
+			h.build(s, st);
+
+		h.dirty.resize(st.entities.size());
+
+		for (std::vector<node>& level : h.levels)
+		{
+			auto work = [&](uint32_t b, uint32_t e)
+			{
+				for (uint32_t i = b; i < e; i++)
+					h.propagate(s, st, level[i]);
+			};
+
+			if (st.jobs && level.size() >= PARALLEL_LEVEL_SIZE)
+				st.jobs->parallel_for(level.size(), 0, work);
+			else
+				work(0, level.size());
+		}
+
+		// Chunk ticks are shared between rows on different threads, so they are set once every level is done
+		component_index world = component_type<world_transform>::id;
+		for (std::vector<node>& level : h.levels) { for (node& n : level)
+		{
+			if (rebuilt)
+				n.placed = false;
+			if (!h.dirty[n.entity])
+				continue;
+
+			ENGINE_PROFILE_COUNT(s.stats, entities, 1);
+			entity& e = st.entities[n.entity];
+			e.arch->chunk_tick(e.arch->chunks[e.chunk_index], world) = s.this_run;
+		}}
+	}
+
+	bool transform_hierarchy::changed(const system& s)
+	{
+		component_index p = component_type<parent>::id;
+
+		for (archetype* a : s.archetypes) { for (chunk& c : a->chunks)
+		{
+			if (newer(c.structure_tick, s.last_run) || (a->has(p) && newer(a->chunk_tick(c, p), s.last_run)))
+				return true;
+		}}
+
+		return false;
+	}
+
+	void transform_hierarchy::build(const system& s, ecs_storage& st)
+	{
+		for (std::vector<node>& level : levels)
+			level.clear();
+		depths.assign(st.entities.size(), NO_ENTITY);
+		previous.swap(parents);
+		parents.assign(st.entities.size(), NOT_PLACED);
+
+		for (archetype* a : s.archetypes) { for (chunk& c : a->chunks)
+		{
+			uint32_t* ids = a->entity_ids(c);
+			for (uint32_t i = 0; i < c.count; i++)
+				place(s, st, ids[i]);
+		}}
+
+		while (!levels.empty() && levels.back().empty())
+			levels.pop_back();
+
+		built = true;
+	}
+
+	void transform_hierarchy::place(const system& s, ecs_storage& st, uint32_t e)
+	{
+		// Walks up to the first placed ancestor or a root, then places the chain top down
+		chain.clear();
+		uint32_t top_parent = NO_ENTITY;
+		uint32_t depth = 0;
+
+		while (depths[e] == NO_ENTITY)
+		{
+			depths[e] = VISITING;
+			chain.push_back(e);
+
+			uint32_t p = parent_node(s, st, e);
+			if (p == NO_ENTITY || depths[p] == VISITING) // A cycle is cut where it is found
+				break;
+
+			if (depths[p] != NO_ENTITY)
+			{
+				top_parent = p;
+				depth = depths[p] + 1;
+				break;
+			}
+
+			e = p;
+		}
+
+		for (int i = chain.size() - 1; i >= 0; i--, depth++)
+		{
+			if (depth >= levels.size())
+				levels.resize(depth + 1);
+
+			uint32_t c = chain[i];
+			uint32_t p = i == (int)chain.size() - 1 ? top_parent : chain[i + 1];
+
+			depths[c] = depth;
+			parents[c] = p;
+			levels[depth].push_back(node{ c, p, c >= previous.size() || previous[c] != p });
+		}
+	}
+
+	uint32_t transform_hierarchy::parent_node(const system& s, ecs_storage& st, uint32_t e)
+	{
+		entity& en = st.entities[e];
+		if (!en.arch->has(component_type<parent>::id))
+			return NO_ENTITY;
+
+		entity* p = st.get(en.get<parent>().handle);
+		return p && s.q.matches(p->arch->mask) ? p->id : NO_ENTITY;
+	}
+
+	void transform_hierarchy::propagate(const system& s, ecs_storage& st, const node& n)
+	{
+		entity& e = st.entities[n.entity];
+		chunk& c = e.arch->chunks[e.chunk_index];
+
+		bool d = n.placed || newer(e.arch->ticks(c, local)[e.row], s.last_run) || (n.parent != NO_ENTITY && dirty[n.parent]);
+		dirty[n.entity] = d;
+
+		if (!d)
+			return;
+
+		matrix4 m = local_matrix(s.function, e);
+		if (n.parent != NO_ENTITY)
+			m = st.entities[n.parent].get<world_transform>().matrix * m;
+
+		e.get<world_transform>().matrix = m;
+		e.arch->ticks(c, component_type<world_transform>::id)[e.row] = s.this_run;
+	}
+}
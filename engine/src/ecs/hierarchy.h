@@ -0,0 +1,84 @@
+#pragma once
+
+#include "pch.h"
+
+#include "maths/types/matrix4.h"
+
+#include "ecs/ecs.h"
+
+namespace engine
+{
+	// Makes the entity's world_transform relative to the handle's, entities without one (or whose parent is gone) are roots
+	struct parent
+	{
+		entity_handle handle;
+	};
+
+	// Filled in by transform propagation from the local transform and the parent's world_transform
+	struct world_transform
+	{
+		matrix4 matrix;
+	};
+
+	// Propagation state of an ecs_storage, nodes are the entities with both the local transform and world_transform
+	class transform_hierarchy
+	{
+	public:
+		// Levels smaller than this are propagated on the calling thread
+		static const uint32_t PARALLEL_LEVEL_SIZE = 256;
+
+		struct node
+		{
+			uint32_t entity;
+			uint32_t parent; // NO_ENTITY for roots
+			bool placed; // New to the hierarchy or under another parent since the last build, cleared once it has been recomputed
+		};
+
+		component_index local;
+		// Calls the system's function, a matrix4 (*)(const T&), on the entity's local transform
+		matrix4 (*local_matrix)(void (*f)(), entity& e);
+
+		std::vector<std::vector<node>> levels; // Nodes by depth, every parent is in an earlier level than its children
+		bool built = false;
+
+		transform_hierarchy(component_index l, matrix4 (*lm)(void (*f)(), entity& e)) : local(l), local_matrix(lm) {}
+
+		// The run_group of the propagation system, walks the levels in order and each level in parallel
+		// Only nodes whose local transform changed or that were placed under another parent, and their subtrees, are recomputed
+		static void run(const system& s, float dt, ecs_storage& st);
+
+	private:
+		std::vector<uint32_t> depths; // Indexed by entity id
+		std::vector<uint32_t> parents; // Indexed by entity id, each node's parent as of the last build
+		std::vector<uint32_t> previous; // parents of the build before, swapped with it so neither is reallocated
+		std::vector<uint8_t> dirty; // Indexed by entity id, set when the node was recomputed by this run
+		std::vector<uint32_t> chain;
+
+		bool changed(const system& s);
+		void build(const system& s, ecs_storage& st);
+		void place(const system& s, ecs_storage& st, uint32_t e);
+		uint32_t parent_node(const system& s, ecs_storage& st, uint32_t e);
+		void propagate(const system& s, ecs_storage& st, const node& n);
+	};
+
+	template<class... Ts>
+	template<typename T>
+	void ecs_manager<Ts...>::add_transform_propagation(int o, matrix4 (*local)(const T&))
+	{
+		static_assert(!is_sparse<T> && !is_sparse<parent> && !is_sparse<world_transform>, "Change ticks are only kept for archetype components");
+
+		create_hierarchy(new transform_hierarchy(id<T>, [](void (*f)(), entity& e) { return ((matrix4 (*)(const T&))f)(e.get<T>()); }));
+
+		systems.push_back(system(o, nullptr, (void (*)())local));
+		system& s = systems.back();
+		s.run_group = &transform_hierarchy::run;
+		s.q.all.set(id<T>);
+		s.q.all.set(id<world_transform>);
+		s.reads.set(id<T>);
+		s.reads.set(id<parent>);
+		s.writes.set(id<world_transform>);
+		s.written.push_back(id<world_transform>);
+
+		add_system_helper<0>(systems.size() - 1);
+	}
+}
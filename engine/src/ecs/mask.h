@@ -0,0 +1,118 @@
+#pragma once
+
+#include "pch.h"
+
+namespace engine
+{
+	// Component ids start at 1, so this many components fit in one 64 bit word by default
+	// The engine and every project using it have to be built with the same value
+#ifndef ENGINE_MAX_COMPONENTS
+#define ENGINE_MAX_COMPONENTS 63
+#endif
+
+	static_assert(ENGINE_MAX_COMPONENTS > 0 && ENGINE_MAX_COMPONENTS < UINT16_MAX, "Component ids are 16 bit");
+
+	const int NO_COMPONENTS = ENGINE_MAX_COMPONENTS + 1;
+	const int NO_COMPONENT_IS = (NO_COMPONENTS + 63) / 64;
+
+	class ecs_mask
+	{
+	public:
+		uint64_t mask[NO_COMPONENT_IS];
+
+		ecs_mask()
+		{
+			std::fill_n(mask, NO_COMPONENT_IS, 0);
+		}
+
+		void set(int i)
+		{
+			int offset = i % 64;
+			int v_index = (i - offset) / 64;
+			mask[v_index] = mask[v_index] | ((uint64_t)1 << offset);
+		}
+
+		void reset(int i)
+		{
+			int offset = i % 64;
+			int v_index = (i - offset) / 64;
+
+			mask[v_index] = mask[v_index] & ~((uint64_t)1 << offset);
+		}
+
+		// True if every bit set in m is also set in this mask
+		inline bool contains(const ecs_mask& m) const
+		{
+			for (int i = 0; i < NO_COMPONENT_IS; i++)
+			{
+				if ((mask[i] & m.mask[i]) != m.mask[i])
+					return false;
+			}
+			return true;
+		}
+
+		inline bool intersects(const ecs_mask& m) const
+		{
+			for (int i = 0; i < NO_COMPONENT_IS; i++)
+			{
+				if (mask[i] & m.mask[i])
+					return true;
+			}
+			return false;
+		}
+
+		inline bool operator==(const ecs_mask& m) const
+		{
+			for (int i = 0; i < NO_COMPONENT_IS; i++)
+			{
+				if (mask[i] != m.mask[i])
+					return false;
+			}
+			return true;
+		}
+
+		// Arbitrary but consistent order, used to group equal masks together
+		inline bool operator<(const ecs_mask& m) const
+		{
+			for (int i = 0; i < NO_COMPONENT_IS; i++)
+			{
+				if (mask[i] != m.mask[i])
+					return mask[i] < m.mask[i];
+			}
+			return false;
+		}
+
+		inline ecs_mask operator|(const ecs_mask& m) const
+		{
+			ecs_mask r;
+			for (int i = 0; i < NO_COMPONENT_IS; i++)
+				r.mask[i] = mask[i] | m.mask[i];
+			return r;
+		}
+		inline ecs_mask operator&(const ecs_mask& m) const
+		{
+			ecs_mask r;
+			for (int i = 0; i < NO_COMPONENT_IS; i++)
+				r.mask[i] = mask[i] & m.mask[i];
+			return r;
+		}
+
+		inline bool empty() const
+		{
+			for (int i = 0; i < NO_COMPONENT_IS; i++)
+			{
+				if (mask[i])
+					return false;
+			}
+			return true;
+		}
+
+		inline bool operator[](int i) const
+		{
+			int offset = i % 64;
+			int v_index = (i - offset) / 64;
+
+			return mask[v_index] & ((uint64_t)1 << offset);
+		}
+	};
+}
@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "profiler.h"
+
+namespace engine
+{
+	double profiler::time(const frame_stats& f, int system) const
+	{
+		if (system < 0)
+			return f.time;
+
+		return system < (int)f.systems.size() ? f.systems[system].time : 0;
+	}
+
+	double profiler::average(int system) const
+	{
+		if (count == 0)
+			return 0;
+
+		double total = 0;
+		for (uint32_t i = 0; i < count; i++)
+			total += time(frame(i), system);
+
+		return total / count;
+	}
+
+	std::vector<uint32_t> profiler::histogram(int system, double bucket_ms, uint32_t buckets) const
+	{
+		std::vector<uint32_t> h(buckets);
+		if (buckets == 0)
+			return h;
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t b = (uint32_t)std::min(time(frame(i), system) / bucket_ms, (double)(buckets - 1));
+			h[b]++;
+		}
+
+		return h;
+	}
+
+	double profiler::occupancy(int thread, uint32_t back) const
+	{
+		const frame_stats& f = frame(back);
+		if (back >= count || thread >= (int)f.busy.size() || f.time <= 0)
+			return 0;
+
+		return f.busy[thread] / f.time;
+	}
+
+	frame_stats& profiler::begin_frame()
+	{
+		frame_stats& f = ring[next];
+		f.time = 0;
+		f.systems.clear();
+		f.busy.clear();
+
+		return f;
+	}
+
+	void profiler::end_frame()
+	{
+		next = (next + 1) % HISTORY;
+		count = std::min(count + 1, HISTORY);
+	}
+}
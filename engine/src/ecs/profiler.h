@@ -0,0 +1,74 @@
+#pragma once
+
+#include "pch.h"
+
+#include "jobs/job_system.h"
+
+namespace engine
+{
+	struct system_stats
+	{
+		void (*function)() = nullptr; // The system's function, to tell systems apart
+		double time = 0; // Milliseconds, summed over the frame's runs as are the counts
+		uint32_t runs = 0; // One per fixed step run in the frame for fixed stage systems, 0 when the system's stage did not run
+		uint32_t entities = 0; // Entities the system was run over, or nodes recomputed for transform propagation
+		uint32_t chunks = 0; // Chunks visited, 0 for systems that do not walk chunks
+		int thread = 0; // job_system::thread_index of the thread that ran it
+	};
+
+	struct frame_stats
+	{
+		double time = 0; // Milliseconds spent in the frame's updates, every fixed step and the frame stage, including playing back commands and observers
+		std::vector<system_stats> systems; // In schedule order
+		std::vector<double> busy; // Milliseconds each job system thread spent running jobs, just the calling thread without one
+	};
+
+	// Keeps the stats of the last HISTORY frames, ecs_storage only has one when ENGINE_PROFILE is set
+	class profiler
+	{
+	public:
+		static constexpr uint32_t HISTORY = 256;
+
+		profiler() : ring(HISTORY) {}
+
+		uint32_t frames() const { return count; }
+		// back frames before the latest one
+		const frame_stats& frame(uint32_t back = 0) const { return ring[(next + HISTORY - 1 - back) % HISTORY]; }
+
+		// Mean time over the kept frames of the system at index system in the schedule, or of the whole update for -1
+		double average(int system) const;
+		// Kept frames counted into buckets of bucket_ms by the time of a system (or of the update for -1), the last bucket also takes every longer frame
+		std::vector<uint32_t> histogram(int system, double bucket_ms, uint32_t buckets) const;
+		// Share of the frame's update the thread spent running jobs
+		double occupancy(int thread, uint32_t back = 0) const;
+
+		// The slot for the next frame, reusing the storage of the frame it replaces
+		frame_stats& begin_frame();
+		void end_frame();
+
+	private:
+		std::vector<frame_stats> ring;
+		uint32_t next = 0;
+		uint32_t count = 0;
+
+		double time(const frame_stats& f, int system) const;
+	};
+
+#if ENGINE_PROFILE
+	// Adds the time until the end of the scope to a system's stats
+	struct profile_scope
+	{
+		system_stats& stats;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		profile_scope(system_stats& s) : stats(s) {}
+		~profile_scope() { stats.time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+	};
+
+#define ENGINE_PROFILE_SCOPE(stats) profile_scope profile_scope_(stats)
+#define ENGINE_PROFILE_COUNT(stats, field, n) ((stats).field += (n))
+#else
+#define ENGINE_PROFILE_SCOPE(stats)
+#define ENGINE_PROFILE_COUNT(stats, field, n)
+#endif
+}
@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "query.h"
+
+#include <emmintrin.h>
+
+namespace engine
+{
+	// Bit i of the result is set if 64 bit lane i of v is zero
+	static inline int zero_lanes(__m128i v)
+	{
+		int bytes = _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128()));
+		return ((bytes & 0x00FF) == 0x00FF) | (((bytes & 0xFF00) == 0xFF00) << 1);
+	}
+
+	// Loads words i and i + 1, or just i with a zero upper lane at the end of the mask
+	static inline __m128i load_words(const uint64_t* words, int i, int count)
+	{
+		if (i + 1 < count)
+			return _mm_loadu_si128((const __m128i*)(words + i));
+		return _mm_loadl_epi64((const __m128i*)(words + i));
+	}
+
+	void query::match(const ecs_mask* masks, uint32_t count, std::vector<uint32_t>& out) const
+	{
+		bool need_any = !any.empty();
+
+		// Single word masks sit next to each other, so two archetypes are tested per register
+		if (NO_COMPONENT_IS == 1 && sizeof(ecs_mask) == sizeof(uint64_t))
+		{
+			__m128i a = _mm_set1_epi64x(all.mask[0]);
+			__m128i y = _mm_set1_epi64x(any.mask[0]);
+			__m128i n = _mm_set1_epi64x(none.mask[0]);
+
+			const uint64_t* words = (const uint64_t*)masks;
+
+			uint32_t i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				__m128i m = _mm_loadu_si128((const __m128i*)(words + i));
+
+				int missing = zero_lanes(_mm_andnot_si128(m, a)) ^ 3;
+				int excluded = zero_lanes(_mm_and_si128(m, n)) ^ 3;
+				int no_any = need_any ? zero_lanes(_mm_and_si128(m, y)) : 0;
+
+				int fails = missing | excluded | no_any;
+				if (!(fails & 1))
+					out.push_back(i);
+				if (!(fails & 2))
+					out.push_back(i + 1);
+			}
+
+			for (; i < count; i++)
+			{
+				if (matches(masks[i]))
+					out.push_back(i);
+			}
+
+			return;
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			__m128i missing = _mm_setzero_si128();
+			__m128i excluded = _mm_setzero_si128();
+			__m128i found = _mm_setzero_si128();
+
+			for (int w = 0; w < NO_COMPONENT_IS; w += 2)
+			{
+				__m128i m = load_words(masks[i].mask, w, NO_COMPONENT_IS);
+
+				missing = _mm_or_si128(missing, _mm_andnot_si128(m, load_words(all.mask, w, NO_COMPONENT_IS)));
+				excluded = _mm_or_si128(excluded, _mm_and_si128(m, load_words(none.mask, w, NO_COMPONENT_IS)));
+				found = _mm_or_si128(found, _mm_and_si128(m, load_words(any.mask, w, NO_COMPONENT_IS)));
+			}
+
+			if (zero_lanes(missing) == 3 && zero_lanes(excluded) == 3 && (!need_any || zero_lanes(found) != 3))
+				out.push_back(i);
+		}
+	}
+}
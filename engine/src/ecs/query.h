@@ -0,0 +1,131 @@
+#pragma once
+
+#include "pch.h"
+
+#include "ecs/mask.h"
+
+namespace engine
+{
+	// Which archetypes a system runs on
+	struct query
+	{
+		ecs_mask all;
+		ecs_mask any; // Empty unless there is an any_of term, which then needs at least one of these
+		ecs_mask none;
+
+		bool matches(const ecs_mask& m) const { return m.contains(all) && !m.intersects(none) && (any.empty() || m.intersects(any)); }
+
+		// Appends the index of every matching mask to out, testing the masks with SIMD
+		void match(const ecs_mask* masks, uint32_t count, std::vector<uint32_t>& out) const;
+	};
+
+	// Query terms are listed alongside components in add_system, they filter what the system runs on but are never passed to it
+
+	// Only entities whose T changed since the system last ran, per chunk for batched systems
+	template<typename T>
+	struct changed {};
+
+	// Entities with T enabled are skipped
+	template<typename T>
+	struct without {};
+
+	// Entities need at least one of ts, which are accessed the same way as components
+	template<typename... ts>
+	struct any_of {};
+
+	// T is not required, it is still accessed like a component and batched systems are handed an empty span when the chunk does not have it
+	template<typename T>
+	struct optional {};
+
+	// The world's resource T, batched systems are handed a reference to it and res<const T> only reads it
+	template<typename T>
+	struct res {};
+
+	enum term_kind
+	{
+		term_component,
+		term_changed,
+		term_without,
+		term_any,
+		term_optional,
+		term_resource,
+	};
+
+	template<typename T>
+	struct term_traits
+	{
+		static const term_kind kind = term_component;
+	};
+
+	template<typename T>
+	struct term_traits<changed<T>>
+	{
+		static const term_kind kind = term_changed;
+		typedef T component;
+	};
+
+	template<typename T>
+	struct term_traits<without<T>>
+	{
+		static const term_kind kind = term_without;
+		typedef T component;
+	};
+
+	template<typename... ts>
+	struct term_traits<any_of<ts...>>
+	{
+		static const term_kind kind = term_any;
+	};
+
+	template<typename T>
+	struct term_traits<optional<T>>
+	{
+		static const term_kind kind = term_optional;
+		typedef T component;
+	};
+
+	template<typename T>
+	struct column_type
+	{
+		typedef T type;
+	};
+
+	template<typename T>
+	struct column_type<optional<T>>
+	{
+		typedef T type;
+	};
+
+	template<typename T>
+	struct term_traits<res<T>>
+	{
+		static const term_kind kind = term_resource;
+		typedef T component;
+	};
+
+	// Terms handed to batched systems as a span, tags (empty components) have no column and only filter
+	template<typename T>
+	constexpr bool is_column = (term_traits<T>::kind == term_component || term_traits<T>::kind == term_optional) && !std::is_empty_v<std::remove_const_t<typename column_type<T>::type>>;
+
+	template<typename... ts>
+	struct type_list {};
+
+	template<typename T>
+	constexpr bool is_argument = is_column<T> || term_traits<T>::kind == term_resource;
+
+	// The arguments of a system's type list, columns and resources, with the filtering terms removed
+	template<typename L, typename... ts>
+	struct data_list_helper;
+
+	template<typename... ds>
+	struct data_list_helper<type_list<ds...>>
+	{
+		typedef type_list<ds...> type;
+	};
+
+	template<typename... ds, typename t, typename... ts>
+	struct data_list_helper<type_list<ds...>, t, ts...> : std::conditional_t<is_argument<t>, data_list_helper<type_list<ds..., t>, ts...>, data_list_helper<type_list<ds...>, ts...>> {};
+
+	template<typename... ts>
+	using data_list = typename data_list_helper<type_list<>, ts...>::type;
+}
@@ -0,0 +1,346 @@
+#include "pch.h"
+#include "rollback.h"
+
+namespace engine
+{
+	rollback_buffer::rollback_buffer(ecs_storage& st, uint32_t frames) : storage(st), max_frames(std::max(frames, (uint32_t)1))
+	{
+		for (uint32_t i = 1; i < storage.component_infos.size(); i++)
+		{
+			if (!storage.component_infos[i].trivial)
+				throw std::runtime_error("Only trivially copyable components can be rolled back");
+		}
+
+		storage.track_moves = true;
+		storage.moved_entities.clear();
+	}
+
+	rollback_buffer::~rollback_buffer()
+	{
+		storage.track_moves = false;
+		storage.moved_entities.clear();
+	}
+
+	uint32_t rollback_buffer::capture()
+	{
+		frame_data f;
+		// Changes made after the capture are newer than it
+		f.tick = storage.next_tick();
+		f.entity_count = storage.entities.size();
+		f.free_entities = storage.free_entities;
+		save_pools(f);
+
+		std::unordered_map<archetype*, uint32_t> indices;
+		for (uint32_t i = 0; i < storage.archetypes.size(); i++)
+		{
+			archetype* a = storage.archetypes[i];
+			indices[a] = i;
+			f.counts.push_back(a->count);
+
+			uint32_t used = (a->count + a->capacity - 1) / a->capacity;
+			for (uint32_t ci = 0; ci < used; ci++)
+			{
+				chunk& c = a->chunks[ci];
+
+				bool changed = full || newer(c.structure_tick, last_tick);
+				for (component_info& info : a->columns)
+					changed = changed || newer(a->chunk_tick(c, info.id), last_tick);
+
+				if (changed)
+					f.chunks[key(i, ci)] = copy_chunk(c.data);
+			}
+		}
+
+		auto save = [&](uint32_t i)
+		{
+			entity& e = storage.entities[i];
+			f.entities[i] = saved_entity{ e.generation, e.alive() ? indices[e.arch] : NO_ENTITY, e.chunk_index, e.row };
+		};
+
+		if (full)
+		{
+			for (uint32_t i = 0; i < f.entity_count; i++)
+				save(i);
+		}
+		else
+		{
+			for (uint32_t i : storage.moved_entities)
+				save(i);
+		}
+		storage.moved_entities.clear();
+
+		last_tick = f.tick;
+		full = false;
+
+		history.push_back(std::move(f));
+		if (history.size() > max_frames)
+		{
+			fold(history.front());
+			history.pop_front();
+			first++;
+		}
+
+		return first + history.size() - 1;
+	}
+
+	void rollback_buffer::restore(uint32_t frame)
+	{
+		if (!has(frame))
+			throw std::runtime_error("Frame is no longer in the rollback buffer");
+
+		int t = frame - first;
+		frame_data& target = history[t];
+
+		// Only what changed after the frame has to be put back, which is every later frame's delta plus anything since the last capture
+		std::vector<uint64_t> chunks;
+		std::vector<uint32_t> ents(storage.moved_entities);
+		for (int j = t + 1; j < (int)history.size(); j++)
+		{
+			for (auto& c : history[j].chunks)
+				chunks.push_back(c.first);
+			for (auto& e : history[j].entities)
+				ents.push_back(e.first);
+		}
+
+		for (uint32_t i = 0; i < storage.archetypes.size(); i++)
+		{
+			archetype* a = storage.archetypes[i];
+			uint32_t used = (a->count + a->capacity - 1) / a->capacity;
+			uint32_t needed = i < target.counts.size() ? (target.counts[i] + a->capacity - 1) / a->capacity : 0;
+
+			for (uint32_t ci = 0; ci < used; ci++)
+			{
+				chunk& c = a->chunks[ci];
+
+				bool changed = newer(c.structure_tick, last_tick);
+				for (component_info& info : a->columns)
+					changed = changed || newer(a->chunk_tick(c, info.id), last_tick);
+
+				if (changed)
+					chunks.push_back(key(i, ci));
+			}
+
+			// Chunks emptied since the frame come back
+			for (uint32_t ci = used; ci < needed; ci++)
+				chunks.push_back(key(i, ci));
+
+			a->restore_count(i < target.counts.size() ? target.counts[i] : 0);
+		}
+
+		std::sort(chunks.begin(), chunks.end());
+		chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+		std::sort(ents.begin(), ents.end());
+		ents.erase(std::unique(ents.begin(), ents.end()), ents.end());
+
+		// Restored chunks count as changed
+		uint32_t tick = storage.next_tick();
+
+		for (uint64_t k : chunks)
+		{
+			archetype* a = storage.archetypes[k >> 32];
+			uint32_t ci = (uint32_t)k;
+
+			// Chunks the frame did not use, the archetype's spare included, have nothing to restore
+			if (ci >= (a->count + a->capacity - 1) / a->capacity)
+				continue;
+
+			chunk& c = a->chunks[ci];
+			memcpy(c.data, find_chunk(t, k), CHUNK_SIZE);
+
+			for (component_info& info : a->columns)
+			{
+				uint32_t* ticks = a->ticks(c, info.id);
+				std::fill(ticks, ticks + c.count, tick);
+				a->chunk_tick(c, info.id) = tick;
+			}
+			c.structure_tick = tick;
+		}
+
+		while (storage.entities.size() > target.entity_count)
+			storage.entities.pop_back();
+
+		for (uint32_t i : ents)
+		{
+			if (i >= target.entity_count)
+				continue;
+
+			const saved_entity* s = find_entity(t, i);
+			entity& e = storage.entities[i];
+			e.generation = s->generation;
+			e.arch = s->archetype == NO_ENTITY ? nullptr : storage.archetypes[s->archetype];
+			e.chunk_index = s->chunk_index;
+			e.row = s->row;
+		}
+
+		storage.free_entities = target.free_entities;
+		load_pools(t);
+
+		while ((int)history.size() > t + 1)
+		{
+			recycle(history.back());
+			history.pop_back();
+		}
+
+		storage.moved_entities.clear();
+		last_tick = tick - 1;
+	}
+
+	size_t rollback_buffer::bytes(uint32_t frame) const
+	{
+		if (!has(frame))
+			return 0;
+
+		const frame_data& f = history[frame - first];
+
+		size_t b = sizeof(frame_data) + f.chunks.size() * (CHUNK_SIZE + sizeof(uint64_t) + sizeof(void*));
+		b += f.entities.size() * (sizeof(saved_entity) + sizeof(uint32_t));
+		b += (f.counts.size() + f.free_entities.size()) * sizeof(uint32_t);
+		for (const std::vector<uint8_t>& p : f.pools)
+			b += p.size();
+
+		return b;
+	}
+
+	std::unique_ptr<uint8_t[]> rollback_buffer::copy_chunk(const uint8_t* data)
+	{
+		std::unique_ptr<uint8_t[]> c;
+		if (spare.empty())
+			c.reset(new uint8_t[CHUNK_SIZE]);
+		else
+		{
+			c = std::move(spare.back());
+			spare.pop_back();
+		}
+
+		memcpy(c.get(), data, CHUNK_SIZE);
+		return c;
+	}
+
+	void rollback_buffer::save_pools(frame_data& f)
+	{
+		f.pools.resize(storage.pools.size());
+		pool_versions.resize(storage.pools.size());
+
+		for (uint32_t i = 1; i < storage.pools.size(); i++)
+		{
+			sparse_pool* p = storage.pools[i];
+			if (!p || (!full && p->version == pool_versions[i]))
+				continue;
+
+			pool_versions[i] = p->version;
+
+			uint32_t size = storage.component_infos[i].size;
+			uint32_t count = p->size();
+			size_t data_offset = (sizeof(uint32_t) * (count + 1) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+			std::vector<uint8_t>& buf = f.pools[i];
+			buf.resize(data_offset + (size_t)count * size);
+			memcpy(buf.data(), &count, sizeof(uint32_t));
+			if (count)
+				memcpy(buf.data() + sizeof(uint32_t), p->dense.data(), count * sizeof(uint32_t));
+
+			for (uint32_t e = 0; e < count;)
+			{
+				uint32_t n = std::min(count - e, DEFAULT_PAGE_SIZE - e % DEFAULT_PAGE_SIZE);
+				memcpy(buf.data() + data_offset + (size_t)e * size, p->entry(e), (size_t)n * size);
+				e += n;
+			}
+		}
+	}
+
+	void rollback_buffer::load_pools(int t)
+	{
+		for (uint32_t i = 1; i < storage.pools.size(); i++)
+		{
+			sparse_pool* p = storage.pools[i];
+			if (!p)
+				continue;
+
+			// Pools untouched since the frame are already as they were
+			bool changed = p->version != pool_versions[i];
+			for (int j = t + 1; j < (int)history.size(); j++)
+				changed = changed || !history[j].pools[i].empty();
+
+			if (changed)
+			{
+				while (p->size() > 0)
+					p->remove(p->dense.back());
+
+				const std::vector<uint8_t>& buf = find_pool(t, i);
+				uint32_t count;
+				memcpy(&count, buf.data(), sizeof(uint32_t));
+				size_t data_offset = (sizeof(uint32_t) * (count + 1) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+				p->load(count, (const uint32_t*)(buf.data() + sizeof(uint32_t)), buf.data() + data_offset);
+			}
+
+			pool_versions[i] = p->version;
+		}
+	}
+
+	const uint8_t* rollback_buffer::find_chunk(int i, uint64_t k) const
+	{
+		for (; i >= 0; i--)
+		{
+			auto it = history[i].chunks.find(k);
+			if (it != history[i].chunks.end())
+				return it->second.get();
+		}
+
+		return base.chunks.at(k).get();
+	}
+
+	const saved_entity* rollback_buffer::find_entity(int i, uint32_t e) const
+	{
+		for (; i >= 0; i--)
+		{
+			auto it = history[i].entities.find(e);
+			if (it != history[i].entities.end())
+				return &it->second;
+		}
+
+		return &base.entities.at(e);
+	}
+
+	const std::vector<uint8_t>& rollback_buffer::find_pool(int i, uint32_t p) const
+	{
+		for (; i >= 0; i--)
+		{
+			if (!history[i].pools[p].empty())
+				return history[i].pools[p];
+		}
+
+		return base.pools[p];
+	}
+
+	void rollback_buffer::fold(frame_data& f)
+	{
+		for (auto& c : f.chunks)
+		{
+			std::unique_ptr<uint8_t[]>& b = base.chunks[c.first];
+			if (b)
+				spare.push_back(std::move(b));
+			b = std::move(c.second);
+		}
+		for (auto& e : f.entities)
+			base.entities[e.first] = e.second;
+
+		base.tick = f.tick;
+		base.entity_count = f.entity_count;
+		base.counts = std::move(f.counts);
+		base.free_entities = std::move(f.free_entities);
+		base.pools.resize(f.pools.size());
+		for (uint32_t i = 0; i < f.pools.size(); i++)
+		{
+			if (!f.pools[i].empty())
+				base.pools[i] = std::move(f.pools[i]);
+		}
+	}
+
+	void rollback_buffer::recycle(frame_data& f)
+	{
+		for (auto& c : f.chunks)
+			spare.push_back(std::move(c.second));
+		f.chunks.clear();
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pch.h"
+
+#include "ecs/ecs.h"
+
+namespace engine
+{
+	// Where an entity was at a captured frame
+	struct saved_entity
+	{
+		uint32_t generation;
+		uint32_t archetype; // Index into ecs_storage::archetypes, NO_ENTITY if the entity was destroyed
+		uint32_t chunk_index;
+		uint32_t row;
+	};
+
+	// Keeps the last few frames of a world so it can be rewound and simulated again
+	// Every frame only stores the chunks and entity slots that changed since the frame before, components have to be trivially copyable
+	// shared<T> components are restored as the pointers they held, which stay valid as shared values live as long as the world
+	class rollback_buffer
+	{
+	public:
+		rollback_buffer(ecs_storage& st, uint32_t frames);
+		~rollback_buffer();
+
+		rollback_buffer(const rollback_buffer&) = delete;
+		rollback_buffer& operator=(const rollback_buffer&) = delete;
+
+		// Returns the captured frame's number, the oldest frame is folded into the base once there are more than the buffer holds
+		uint32_t capture();
+		// Puts the world back as it was when the frame was captured and forgets every later frame
+		// Restored chunks count as changed, so change filters and observers see the rewind
+		void restore(uint32_t frame);
+
+		bool has(uint32_t frame) const { return frame >= first && frame < first + history.size(); }
+		// Memory held by one frame
+		size_t bytes(uint32_t frame) const;
+
+	private:
+		struct frame_data
+		{
+			uint32_t tick = 0; // World change tick at capture
+			uint32_t entity_count = 0;
+			std::vector<uint32_t> counts; // Entities per archetype
+			std::vector<uint32_t> free_entities;
+			std::vector<std::vector<uint8_t>> pools; // Sparse pools changed since the frame before as count, ids and components, empty if unchanged
+
+			std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> chunks; // Changed chunks, keyed by archetype index << 32 | chunk index
+			std::unordered_map<uint32_t, saved_entity> entities; // Changed entity slots
+		};
+
+		ecs_storage& storage;
+		uint32_t max_frames;
+
+		frame_data base; // Everything older than the first frame, folded together
+		std::deque<frame_data> history;
+		uint32_t first = 0; // Number of history.front()
+		uint32_t last_tick = 0;
+		bool full = true; // The next capture stores everything
+		std::vector<uint32_t> pool_versions; // Of each sparse pool at the last capture
+
+		std::vector<std::unique_ptr<uint8_t[]>> spare; // Chunk copies of dropped frames, reused by capture
+
+		static uint64_t key(uint32_t a, uint32_t ci) { return (uint64_t)a << 32 | ci; }
+		std::unique_ptr<uint8_t[]> copy_chunk(const uint8_t* data);
+
+		void save_pools(frame_data& f);
+		void load_pools(int t);
+
+		// The chunk or entity slot as it was at history[i], searching back through older frames and then the base
+		const uint8_t* find_chunk(int i, uint64_t k) const;
+		const saved_entity* find_entity(int i, uint32_t e) const;
+		const std::vector<uint8_t>& find_pool(int i, uint32_t p) const;
+
+		void fold(frame_data& f);
+		void recycle(frame_data& f);
+	};
+}
@@ -0,0 +1,34 @@
+#include "pch.h"
+#include "scheduler.h"
+
+namespace engine
+{
+	uint32_t fixed_scheduler::update(ecs_storage& world, double frame_time)
+	{
+		accumulator += std::max(frame_time, 0.0);
+
+		uint32_t steps = (uint32_t)std::min(accumulator / step, (double)max_steps);
+		if (steps == max_steps && accumulator >= (max_steps + 1) * step)
+		{
+			lost += accumulator - max_steps * step;
+			accumulator = max_steps * step;
+		}
+
+		fixed_time& ft = world.has_resource<fixed_time>() ? world.resource<fixed_time>() : world.add_resource(fixed_time());
+		ft.step = (float)step;
+
+		world.begin_frame();
+		for (uint32_t i = 0; i < steps; i++)
+		{
+			ft.tick = ++tick;
+			world.update((float)step, stage_fixed);
+			accumulator -= step;
+		}
+
+		ft.alpha = alpha();
+		world.update((float)frame_time, stage_frame);
+		world.end_frame();
+
+		return steps;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.h"
+
+#include "ecs/ecs.h"
+
+namespace engine
+{
+	// Kept as a resource of the world being stepped, systems list res<const fixed_time> to read it
+	struct fixed_time
+	{
+		float step = 0; // Seconds per fixed step, the dt every fixed system is run with
+		float alpha = 0; // How far the frame is from the last fixed step towards the next one, 0 to 1, for interpolating what is rendered
+		uint64_t tick = 0; // Fixed steps run so far
+	};
+
+	// Runs the fixed stage at a fixed rate whatever the frame rate, so the simulation is deterministic for a given sequence of inputs
+	class fixed_scheduler
+	{
+	public:
+		double step;
+		// Steps run in one frame at most, time beyond that is dropped so a slow frame cannot make the next one slower still
+		uint32_t max_steps;
+
+		fixed_scheduler(double rate, uint32_t max = 5) : step(1.0 / rate), max_steps(max) {}
+
+		// Adds the frame's time and runs as many fixed steps as it covers, then the frame stage once with the frame's time
+		// Returns the number of fixed steps run
+		uint32_t update(ecs_storage& world, double frame_time);
+
+		float alpha() const { return (float)(accumulator / step); }
+		uint64_t ticks() const { return tick; }
+		// Time dropped by the step cap so far
+		double dropped() const { return lost; }
+
+	private:
+		double accumulator = 0;
+		uint64_t tick = 0;
+		double lost = 0;
+	};
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pch.h"
+
+#include "containers/paged_vector.h"
+
+namespace engine
+{
+	// A component pointing at a value stored once per world, every entity given an equal value by ecs_storage::share points at the same one
+	// Shared values are read only and live as long as the world, so they suit small sets of values used by many entities (materials, AI configs)
+	template<typename T>
+	struct shared
+	{
+		const T* value = nullptr;
+
+		const T& operator*() const { return *value; }
+		const T* operator->() const { return value; }
+
+		bool operator==(const shared& s) const { return value == s.value; }
+		bool operator!=(const shared& s) const { return value != s.value; }
+	};
+
+	template<typename T>
+	constexpr bool is_shared = false;
+	template<typename T>
+	constexpr bool is_shared<shared<T>> = true;
+
+	// The distinct values of T in a world, kept as a resource
+	template<typename T>
+	class shared_table
+	{
+	public:
+		// Values are found through std::hash<T> when it is specialised, and by comparing against every value otherwise
+		static constexpr bool hashed = std::is_default_constructible_v<std::hash<T>>;
+
+		const T* intern(const T& v)
+		{
+			size_t h = 0;
+			if constexpr (hashed)
+				h = std::hash<T>()(v);
+
+			auto range = lookup.equal_range(h);
+			for (auto it = range.first; it != range.second; it++)
+			{
+				if (*it->second == v)
+					return it->second;
+			}
+
+			const T* p = &values.push_back(v);
+			lookup.emplace(h, p);
+
+			return p;
+		}
+
+		uint32_t size() const { return values.size(); }
+
+	private:
+		paged_vector<T> values; // Pages never move, so shared<T> can point into them
+		std::unordered_multimap<size_t, const T*> lookup;
+	};
+}
@@ -0,0 +1,379 @@
+#include "pch.h"
+#include "snapshot.h"
+#include "ecs.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace engine
+{
+	static uint64_t align_up(uint64_t v, uint64_t a)
+	{
+		return (v + a - 1) / a * a;
+	}
+
+	mapped_file::mapped_file(const std::string& path)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Failed to open snapshot " + path);
+
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		size = (size_t)file_size.QuadPart;
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (mapping)
+		{
+			data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			throw std::runtime_error("Failed to open snapshot " + path);
+
+		struct stat st;
+		fstat(file, &st);
+		size = (size_t)st.st_size;
+
+		void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		data = view == MAP_FAILED ? nullptr : (uint8_t*)view;
+		close(file);
+#endif
+
+		if (!data)
+			throw std::runtime_error("Failed to map snapshot " + path);
+	}
+
+	mapped_file::~mapped_file()
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(data, size);
+#endif
+	}
+
+	void ecs_storage::save(const std::string& path)
+	{
+		snapshot_header h;
+		h.magic = SNAPSHOT_MAGIC;
+		h.version = SNAPSHOT_VERSION;
+		h.chunk_size = CHUNK_SIZE;
+		h.mask_words = NO_COMPONENT_IS;
+		h.component_count = component_infos.size();
+		h.archetype_count = archetypes.size();
+		h.entity_count = entities.size();
+		h.free_count = free_entities.size();
+		h.change_tick = change_tick;
+		h.padding = 0;
+
+		uint64_t offset = sizeof(snapshot_header)
+			+ h.component_count * sizeof(snapshot_component)
+			+ h.archetype_count * sizeof(snapshot_archetype)
+			+ h.entity_count * sizeof(snapshot_entity)
+			+ h.free_count * sizeof(uint32_t);
+
+		std::vector<snapshot_component> cs(component_infos.size());
+		for (uint32_t i = 1; i < component_infos.size(); i++)
+		{
+			component_info& info = component_infos[i];
+			if (!info.trivial)
+				throw std::runtime_error("Only trivially copyable components can be saved");
+			if (info.pointer)
+				throw std::runtime_error("Shared components point into the world and cannot be saved");
+
+			snapshot_component& c = cs[i];
+			c.size = info.size;
+			c.align = info.align;
+			c.sparse = pools[i] != nullptr;
+			c.count = pools[i] ? pools[i]->size() : 0;
+
+			c.ids_offset = align_up(offset, alignof(uint32_t));
+			c.data_offset = align_up(c.ids_offset + c.count * sizeof(uint32_t), info.align);
+			offset = c.data_offset + c.count * info.size;
+		}
+
+		std::vector<snapshot_archetype> as(archetypes.size());
+		std::unordered_map<archetype*, uint32_t> indices;
+		for (uint32_t i = 0; i < archetypes.size(); i++)
+		{
+			archetype* a = archetypes[i];
+			indices[a] = i;
+
+			snapshot_archetype& s = as[i];
+			s.storage = a->storage;
+			s.mask = a->mask;
+			s.capacity = a->capacity;
+			s.count = a->count;
+			s.chunk_count = (a->count + a->capacity - 1) / a->capacity; // Reserved but unused chunks are left out
+			s.padding = 0;
+
+			s.chunk_offset = align_up(offset, CHUNK_ALIGN);
+			offset = s.chunk_offset + (uint64_t)s.chunk_count * CHUNK_SIZE;
+		}
+
+		std::vector<snapshot_entity> es(entities.size());
+		for (uint32_t i = 0; i < entities.size(); i++)
+		{
+			entity& e = entities[i];
+			es[i].generation = e.generation;
+			es[i].archetype = e.alive() ? indices[e.arch] : NO_ENTITY;
+			es[i].chunk_index = e.alive() ? e.chunk_index : 0;
+			es[i].row = e.alive() ? e.row : 0;
+		}
+
+		// Written next to the target and renamed over it once complete, so a failed save leaves the previous snapshot intact
+		std::string temp = path + ".tmp";
+		std::ofstream f(temp, std::ios::binary | std::ios::trunc);
+		if (!f)
+			throw std::runtime_error("Failed to open snapshot " + temp);
+
+		uint64_t written = 0;
+		auto write = [&](const void* d, uint64_t size)
+		{
+			f.write((const char*)d, size);
+			written += size;
+		};
+		auto pad = [&](uint64_t to)
+		{
+			static const char zeros[CHUNK_ALIGN] = {};
+			while (written < to)
+				write(zeros, std::min(to - written, (uint64_t)CHUNK_ALIGN));
+		};
+
+		write(&h, sizeof(h));
+		write(cs.data(), cs.size() * sizeof(snapshot_component));
+		write(as.data(), as.size() * sizeof(snapshot_archetype));
+		write(es.data(), es.size() * sizeof(snapshot_entity));
+		write(free_entities.data(), free_entities.size() * sizeof(uint32_t));
+
+		for (uint32_t i = 1; i < component_infos.size(); i++)
+		{
+			if (!pools[i])
+				continue;
+
+			pad(cs[i].ids_offset);
+			write(pools[i]->dense.data(), cs[i].count * sizeof(uint32_t));
+
+			pad(cs[i].data_offset);
+			for (uint32_t e = 0; e < cs[i].count;)
+			{
+				uint32_t n = std::min(cs[i].count - e, DEFAULT_PAGE_SIZE - e % DEFAULT_PAGE_SIZE);
+				write(pools[i]->entry(e), (uint64_t)n * cs[i].size);
+				e += n;
+			}
+		}
+
+		for (uint32_t i = 0; i < archetypes.size(); i++)
+		{
+			pad(as[i].chunk_offset);
+			for (uint32_t c = 0; c < as[i].chunk_count; c++)
+				write(archetypes[i]->chunks[c].data, CHUNK_SIZE);
+		}
+
+		f.close();
+		if (!f)
+		{
+			std::remove(temp.c_str());
+			throw std::runtime_error("Failed to write snapshot " + path);
+		}
+
+#ifdef _WIN32
+		bool renamed = MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+		bool renamed = std::rename(temp.c_str(), path.c_str()) == 0;
+#endif
+		if (!renamed)
+		{
+			std::remove(temp.c_str());
+			throw std::runtime_error("Failed to replace snapshot " + path);
+		}
+	}
+
+	void ecs_storage::load(const std::string& path)
+	{
+		if (entities.size() != free_entities.size())
+			throw std::runtime_error("Snapshots can only be loaded into an empty world");
+
+		std::unique_ptr<mapped_file> file(new mapped_file(path));
+
+		const uint8_t* base = file->data;
+		const snapshot_header& h = *(const snapshot_header*)base;
+
+		// Every table and offset is checked against the file before anything is read through it or the world is changed
+		uint64_t size = file->size;
+		auto fits = [&](uint64_t offset, uint64_t length) { return offset <= size && length <= size - offset; };
+		auto corrupt = [&]() { return std::runtime_error("Snapshot " + path + " is truncated or corrupt"); };
+
+		if (!fits(0, sizeof(snapshot_header)) || h.magic != SNAPSHOT_MAGIC)
+			throw std::runtime_error("Not a snapshot " + path);
+		if (h.version != SNAPSHOT_VERSION || h.chunk_size != CHUNK_SIZE || h.mask_words != NO_COMPONENT_IS || h.component_count != component_infos.size())
+			throw std::runtime_error("Snapshot " + path + " was saved with a different version or component list");
+
+		uint64_t tables = (uint64_t)h.component_count * sizeof(snapshot_component)
+			+ (uint64_t)h.archetype_count * sizeof(snapshot_archetype)
+			+ (uint64_t)h.entity_count * sizeof(snapshot_entity)
+			+ (uint64_t)h.free_count * sizeof(uint32_t);
+		if (!fits(sizeof(snapshot_header), tables))
+			throw corrupt();
+
+		const snapshot_component* cs = (const snapshot_component*)(base + sizeof(snapshot_header));
+		const snapshot_archetype* as = (const snapshot_archetype*)(cs + h.component_count);
+		const snapshot_entity* es = (const snapshot_entity*)(as + h.archetype_count);
+		const uint32_t* fs = (const uint32_t*)(es + h.entity_count);
+
+		for (uint32_t i = 1; i < component_infos.size(); i++)
+		{
+			if (cs[i].size != component_infos[i].size || cs[i].align != component_infos[i].align || cs[i].sparse != (pools[i] != nullptr) || !component_infos[i].trivial || component_infos[i].pointer)
+				throw std::runtime_error("Snapshot " + path + " was saved with a different component list");
+
+			if (cs[i].ids_offset % alignof(uint32_t) || cs[i].data_offset % cs[i].align
+				|| !fits(cs[i].ids_offset, (uint64_t)cs[i].count * sizeof(uint32_t)) || !fits(cs[i].data_offset, (uint64_t)cs[i].count * cs[i].size))
+				throw corrupt();
+
+			const uint32_t* ids = (const uint32_t*)(base + cs[i].ids_offset);
+			for (uint32_t e = 0; e < cs[i].count; e++)
+			{
+				if (ids[e] >= h.entity_count || es[ids[e]].archetype == NO_ENTITY)
+					throw corrupt();
+			}
+		}
+
+		for (uint32_t i = 0; i < h.archetype_count; i++)
+		{
+			uint64_t capacity = std::max(as[i].capacity, (uint32_t)1);
+			if (as[i].chunk_count != (as[i].count + capacity - 1) / capacity || as[i].chunk_offset % CHUNK_ALIGN
+				|| !fits(as[i].chunk_offset, (uint64_t)as[i].chunk_count * CHUNK_SIZE))
+				throw corrupt();
+
+			// Only listed components, sparse ones are never stored, and disabled components are still stored
+			for (int c = 0; c < NO_COMPONENTS; c++)
+			{
+				bool listed = c > 0 && c < (int)component_infos.size() && !pools[c];
+				if ((as[i].storage[c] && !listed) || (as[i].mask[c] && !as[i].storage[c]))
+					throw corrupt();
+			}
+
+			for (uint32_t j = 0; j < i; j++)
+			{
+				if (as[j].storage == as[i].storage && as[j].mask == as[i].mask)
+					throw corrupt();
+			}
+
+			// The layout this build gives the archetype, without adding it to the world, which is empty so existing archetypes hold nothing
+			uint32_t expected = 0;
+			for (archetype* a : archetypes)
+			{
+				if (a->storage == as[i].storage && a->mask == as[i].mask)
+					expected = a->capacity;
+			}
+			if (!expected)
+				expected = archetype(this, as[i].storage, as[i].mask, stored_columns(as[i].storage), component_infos.size()).capacity;
+			if (expected != as[i].capacity)
+				throw std::runtime_error("Snapshot " + path + " archetype layout does not match");
+
+			// Every row's entity id leads back to the row
+			for (uint32_t c = 0; c < as[i].chunk_count; c++)
+			{
+				const uint32_t* ids = (const uint32_t*)(base + as[i].chunk_offset + (uint64_t)c * CHUNK_SIZE);
+				uint32_t rows = std::min(as[i].count - c * as[i].capacity, as[i].capacity);
+				for (uint32_t r = 0; r < rows; r++)
+				{
+					if (ids[r] >= h.entity_count || es[ids[r]].archetype != i || es[ids[r]].chunk_index != c || es[ids[r]].row != r)
+						throw corrupt();
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < h.entity_count; i++)
+		{
+			if (es[i].archetype == NO_ENTITY)
+				continue;
+			if (es[i].archetype >= h.archetype_count)
+				throw corrupt();
+
+			const snapshot_archetype& a = as[es[i].archetype];
+			if (es[i].row >= a.capacity || (uint64_t)es[i].chunk_index * a.capacity + es[i].row >= a.count)
+				throw corrupt();
+
+			// Two entities cannot share a row
+			const uint32_t* ids = (const uint32_t*)(base + a.chunk_offset + (uint64_t)es[i].chunk_index * CHUNK_SIZE);
+			if (ids[es[i].row] != i)
+				throw corrupt();
+		}
+
+		for (uint32_t i = 0; i < h.free_count; i++)
+		{
+			if (fs[i] >= h.entity_count || es[fs[i]].archetype != NO_ENTITY)
+				throw corrupt();
+		}
+
+		// Chunk contents, like component bytes, are used as they are
+		snapshots.push_back(file.release());
+		mapped_file* mapped = snapshots.back();
+
+		// Chunks are used in place, only the pointers to them are fixed up
+		std::vector<archetype*> loaded(h.archetype_count);
+		uint32_t tick = next_tick();
+		for (uint32_t i = 0; i < h.archetype_count; i++)
+		{
+			archetype* a = find_archetype(as[i].storage, as[i].mask);
+
+			for (chunk& c : a->chunks)
+			{
+				if (!c.mapped)
+					operator delete(c.data, std::align_val_t(CHUNK_ALIGN));
+			}
+			a->chunks.clear();
+
+			for (uint32_t c = 0; c < as[i].chunk_count; c++)
+			{
+				chunk ch;
+				ch.data = mapped->data + as[i].chunk_offset + (uint64_t)c * CHUNK_SIZE;
+				ch.count = std::min(as[i].count - c * a->capacity, a->capacity);
+				ch.mapped = true;
+				ch.structure_tick = tick;
+				a->chunks.push_back(ch);
+			}
+
+			a->count = as[i].count;
+			loaded[i] = a;
+		}
+
+		entities.clear();
+		entities.reserve(h.entity_count);
+		for (uint32_t i = 0; i < h.entity_count; i++)
+		{
+			entity e;
+			e.id = i;
+			e.generation = es[i].generation;
+			e.arch = es[i].archetype == NO_ENTITY ? nullptr : loaded[es[i].archetype];
+			e.chunk_index = es[i].chunk_index;
+			e.row = es[i].row;
+
+			entities.push_back(std::move(e));
+			track_move(i);
+		}
+
+		free_entities.assign(fs, fs + h.free_count);
+
+		for (uint32_t i = 1; i < component_infos.size(); i++)
+		{
+			if (pools[i])
+				pools[i]->load(cs[i].count, (const uint32_t*)(base + cs[i].ids_offset), base + cs[i].data_offset);
+		}
+
+		// The snapshot's ticks are relative to its change tick
+		if (newer(h.change_tick, change_tick))
+			change_tick = h.change_tick;
+		age_ticks();
+	}
+}
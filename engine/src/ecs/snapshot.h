@@ -0,0 +1,76 @@
+#pragma once
+
+#include "pch.h"
+
+#include "ecs/mask.h"
+
+namespace engine
+{
+	// Snapshot layout, every offset is from the start of the file
+	//   snapshot_header
+	//   snapshot_component[component_count], indexed by component id
+	//   snapshot_archetype[archetype_count]
+	//   snapshot_entity[entity_count]
+	//   uint32_t free_entities[free_count]
+	//   sparse pools, the entity ids then the components, for every sparse component
+	//   archetype chunks, CHUNK_ALIGN aligned and written as they are in memory
+	const uint32_t SNAPSHOT_MAGIC = 0x53534345; // "ECSS"
+	const uint32_t SNAPSHOT_VERSION = 1;
+
+	struct snapshot_header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t chunk_size;
+		uint32_t mask_words;
+		uint32_t component_count;
+		uint32_t archetype_count;
+		uint32_t entity_count;
+		uint32_t free_count;
+		uint32_t change_tick;
+		uint32_t padding;
+	};
+
+	struct snapshot_component
+	{
+		uint32_t size;
+		uint32_t align;
+		uint32_t sparse;
+		uint32_t count; // Entries in the sparse pool
+		uint64_t ids_offset;
+		uint64_t data_offset;
+	};
+
+	struct snapshot_archetype
+	{
+		ecs_mask storage;
+		ecs_mask mask;
+		uint32_t capacity;
+		uint32_t count;
+		uint32_t chunk_count;
+		uint32_t padding;
+		uint64_t chunk_offset;
+	};
+
+	struct snapshot_entity
+	{
+		uint32_t generation;
+		uint32_t archetype; // NO_ENTITY if the entity is destroyed
+		uint32_t chunk_index;
+		uint32_t row;
+	};
+
+	// A copy on write view of a file, loaded chunks point into it so it lives as long as the ecs_storage
+	class mapped_file
+	{
+	public:
+		uint8_t* data = nullptr;
+		size_t size = 0;
+
+		mapped_file(const std::string& path);
+		~mapped_file();
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+	};
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "pch.h"
+
+namespace engine
+{
+	// Contiguous run of components handed to batched systems
+	template<typename T>
+	struct span
+	{
+		T* data;
+		uint32_t size;
+
+		span(T* d, uint32_t s) : data(d), size(s) {}
+
+		inline T& operator[](uint32_t i) const { return data[i]; }
+
+		T* begin() const { return data; }
+		T* end() const { return data + size; }
+	};
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "pch.h"
+
+#include "ecs/archetype.h"
+
+#include "containers/paged_vector.h"
+
+namespace engine
+{
+	enum storage_policy
+	{
+		storage_archetype,
+		storage_sparse,
+	};
+
+	// Specialise for components that are added and removed often, they then live in a sparse_set instead of moving the entity between archetypes
+	template<typename T>
+	struct component_storage
+	{
+		static const storage_policy policy = storage_archetype;
+	};
+
+	template<typename T>
+	constexpr bool is_sparse = component_storage<std::remove_const_t<T>>::policy == storage_sparse;
+
+	// Empty components are tags, an entity has one if the bit is set in its archetype's mask and nothing is stored per entity
+	template<typename T>
+	constexpr bool is_tag = std::is_empty_v<std::remove_const_t<T>>;
+
+	class sparse_group;
+
+	class sparse_pool
+	{
+	public:
+		std::vector<uint32_t> sparse; // Indexed by entity id, NO_ENTITY if the entity has no component
+		std::vector<uint32_t> dense; // Entity ids, packed in the same order as the components
+		sparse_group* group = nullptr; // The group owning the pool, if any
+		uint32_t version = 0; // Bumped by every add, remove and swap, and by systems writing the pool, so unchanged pools can be skipped
+
+		virtual ~sparse_pool() {}
+
+		bool has(uint32_t e) const { return e < sparse.size() && sparse[e] != NO_ENTITY; }
+		uint32_t size() const { return dense.size(); }
+
+		virtual void remove(uint32_t e) = 0;
+		// Swaps two entries, keeping sparse pointing at them
+		virtual void swap(uint32_t i, uint32_t j) = 0;
+
+		// Raw access for snapshots, entries are contiguous within a page
+		virtual const void* entry(uint32_t i) = 0;
+		virtual void load(uint32_t count, const uint32_t* ids, const uint8_t* data) = 0;
+	};
+
+	// Keeps its pools sorted so that the first size entries of each are the entities with every owned component, in the same order
+	class sparse_group
+	{
+	public:
+		std::vector<sparse_pool*> owned;
+		uint32_t size = 0;
+
+		bool contains(uint32_t e) const { return owned[0]->has(e) && owned[0]->sparse[e] < size; }
+
+		// Called once the entity has gained an owned component
+		void enter(uint32_t e)
+		{
+			if (contains(e))
+				return;
+			for (sparse_pool* p : owned)
+			{
+				if (!p->has(e))
+					return;
+			}
+
+			for (sparse_pool* p : owned)
+				p->swap(p->sparse[e], size);
+			size++;
+		}
+
+		// Called before the entity loses an owned component
+		void leave(uint32_t e)
+		{
+			if (!contains(e))
+				return;
+
+			size--;
+			for (sparse_pool* p : owned)
+				p->swap(p->sparse[e], size);
+		}
+	};
+
+	template<typename T>
+	class sparse_set : public sparse_pool
+	{
+	public:
+		paged_vector<T> data; // Paged so references handed out stay valid while the pool grows, removals and groups still move entries
+
+		T& get(uint32_t e) { return data[sparse[e]]; }
+
+		T& add(uint32_t e, T c)
+		{
+			version++;
+			if (has(e))
+				return data[sparse[e]] = std::move(c);
+
+			if (e >= sparse.size())
+				sparse.resize(e + 1, NO_ENTITY);
+
+			sparse[e] = dense.size();
+			dense.push_back(e);
+			data.push_back(std::move(c));
+
+			if (group)
+			{
+				group->enter(e);
+				return data[sparse[e]];
+			}
+
+			return data.back();
+		}
+
+		// Swaps the last component into the removed one's place
+		void remove(uint32_t e) override
+		{
+			if (!has(e))
+				return;
+
+			version++;
+			if (group)
+				group->leave(e);
+
+			uint32_t i = sparse[e];
+			uint32_t last = dense.back();
+
+			data[i] = std::move(data.back());
+			dense[i] = last;
+			sparse[last] = i;
+
+			data.pop_back();
+			dense.pop_back();
+			sparse[e] = NO_ENTITY;
+		}
+
+		const void* entry(uint32_t i) override { return &data[i]; }
+
+		void load(uint32_t count, const uint32_t* ids, const uint8_t* d) override
+		{
+			if constexpr (std::is_trivially_copyable_v<T>)
+			{
+				for (uint32_t i = 0; i < count; i++)
+					add(ids[i], ((const T*)d)[i]);
+			}
+		}
+
+		void swap(uint32_t i, uint32_t j) override
+		{
+			if (i == j)
+				return;
+
+			version++;
+			std::swap(data[i], data[j]);
+			std::swap(dense[i], dense[j]);
+			sparse[dense[i]] = i;
+			sparse[dense[j]] = j;
+		}
+	};
+}
@@ -5,6 +5,8 @@
 #include "graphics/types/material.h"
 #include "graphics/types/mesh_ubo.h"
 
+#include "containers/paged_vector.h"
+
 namespace engine
 {
 	struct renderer_data
@@ -14,7 +16,7 @@ namespace engine
 		static const int MAX_MESH_INSTANCES = 255;
 
 		std::vector<material> materials;
-		std::vector<mesh_ubo> mesh_data;
+		paged_vector<mesh_ubo> mesh_data; // renderer_object keeps pointers into this
 		std::vector<int> instances = std::vector<int>(255);
 		
 		std::vector<vertex> mesh_verticies;
@@ -22,23 +24,11 @@ namespace engine
 		std::vector<int> mesh_vertex_start;
 		std::vector<int> mesh_index_start;
 
+		// Appended rather than inserted next to the mesh's other instances, so earlier objects keep their place
 		void add_object(int id)
 		{
-			mesh_ubo mu;
-
-			int c = 0;
-			for (int i = 0; i < instances.size(); i++)
-			{
-				if (i == id)
-				{
-					std::vector<mesh_ubo>::iterator it = mesh_data.begin() + c;
-
-					mesh_data.insert(it, mu);
-					instances[i]++;
-				}
-				else
-					c += instances[i];
-			}
+			mesh_data.push_back(mesh_ubo());
+			instances[id]++;
 		}
 
 		void add_mesh(std::vector<vertex>& m, std::vector<int>& i)
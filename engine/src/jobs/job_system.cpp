@@ -0,0 +1,188 @@
+#include "pch.h"
+#include "job_system.h"
+
+namespace engine
+{
+	static thread_local job_system* current_system = nullptr;
+	static thread_local int current_queue = 0;
+#if ENGINE_PROFILE
+	static thread_local int run_depth = 0;
+#endif
+
+	bool job_queue::push(const job& j)
+	{
+		acquire();
+
+		bool pushed = back - front < CAPACITY;
+		if (pushed)
+		{
+			jobs[back % CAPACITY] = j;
+			back++;
+		}
+
+		release();
+		return pushed;
+	}
+
+	bool job_queue::pop(job& j)
+	{
+		acquire();
+
+		bool popped = back != front;
+		if (popped)
+		{
+			back--;
+			j = jobs[back % CAPACITY];
+		}
+
+		release();
+		return popped;
+	}
+
+	bool job_queue::steal(job& j)
+	{
+		acquire();
+
+		bool stolen = back != front;
+		if (stolen)
+		{
+			j = jobs[front % CAPACITY];
+			front++;
+		}
+
+		release();
+		return stolen;
+	}
+
+	job_system::job_system(int n)
+	{
+		if (n < 0)
+			n = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+
+		worker_count = n;
+		queues.reset(new job_queue[n + 1]);
+#if ENGINE_PROFILE
+		busy_ns.reset(new std::atomic<uint64_t>[n + 1]);
+		for (int i = 0; i <= n; i++)
+			busy_ns[i] = 0;
+#endif
+
+		for (int i = 0; i < n; i++)
+			threads.push_back(std::thread(&job_system::worker, this, i + 1));
+	}
+
+	job_system::~job_system()
+	{
+		{
+			std::unique_lock<std::mutex> l(m);
+			stopping = true;
+		}
+		cv.notify_all();
+
+		for (std::thread& t : threads)
+			t.join();
+	}
+
+	void job_system::submit(job j, job_counter* counter)
+	{
+		if (counter)
+			counter->fetch_add(1);
+		j.counter = counter;
+
+		// Run it straight away rather than block when the queue is full
+		if (!queues[thread_index()].push(j))
+		{
+			run(j);
+			return;
+		}
+
+		queued++;
+
+		if (sleeping > 0)
+		{
+			{
+				std::unique_lock<std::mutex> l(m);
+			}
+			cv.notify_one();
+		}
+	}
+
+	void job_system::wait(job_counter& counter)
+	{
+		int i = thread_index();
+
+		while (counter > 0)
+		{
+			job j;
+			if (find_job(i, j))
+				run(j);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	void job_system::worker(int i)
+	{
+		current_system = this;
+		current_queue = i;
+
+		while (!stopping)
+		{
+			job j;
+			if (find_job(i, j))
+			{
+				run(j);
+				continue;
+			}
+
+			for (int spin = 0; spin < 64 && queued == 0; spin++)
+				std::this_thread::yield();
+
+			if (queued > 0)
+				continue;
+
+			std::unique_lock<std::mutex> l(m);
+			sleeping++;
+			cv.wait(l, [this]() { return stopping || queued > 0; });
+			sleeping--;
+		}
+	}
+
+	int job_system::thread_index()
+	{
+		return current_system == this ? current_queue : 0;
+	}
+
+	bool job_system::find_job(int i, job& j)
+	{
+		int n = size() + 1;
+
+		bool found = queues[i].pop(j);
+		for (int k = 1; k < n && !found; k++)
+			found = queues[(i + k) % n].steal(j);
+
+		if (found)
+			queued--;
+
+		return found;
+	}
+
+	void job_system::run(job& j)
+	{
+#if ENGINE_PROFILE
+		std::chrono::steady_clock::time_point start;
+		if (run_depth++ == 0)
+			start = std::chrono::steady_clock::now();
+
+		j.function(j.data);
+
+		if (--run_depth == 0)
+			busy_ns[thread_index()] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#else
+		j.function(j.data);
+#endif
+
+		if (j.counter)
+			j.counter->fetch_sub(1);
+	}
+}
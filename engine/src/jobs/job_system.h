@@ -0,0 +1,138 @@
+#pragma once
+
+#include "pch.h"
+
+// Set to 1 to time systems and job system threads, nothing is recorded or stored otherwise
+// The engine and every project using it have to be built with the same value
+#ifndef ENGINE_PROFILE
+#define ENGINE_PROFILE 0
+#endif
+
+namespace engine
+{
+	// Number of jobs still to finish, a job may wait on a counter to depend on other jobs
+	typedef std::atomic<int> job_counter;
+
+	struct job
+	{
+		void (*function)(void*);
+		void* data;
+
+		job_counter* counter = nullptr;
+	};
+
+	// Fixed size ring of jobs, the owning thread pushes and pops at the back and other threads steal from the front
+	class job_queue
+	{
+	public:
+		static const uint32_t CAPACITY = 4096;
+
+		bool push(const job& j);
+		bool pop(job& j);
+		bool steal(job& j);
+
+	private:
+		std::atomic_flag lock = ATOMIC_FLAG_INIT;
+
+		uint32_t front = 0;
+		uint32_t back = 0;
+		job jobs[CAPACITY];
+
+		void acquire() { while (lock.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+		void release() { lock.clear(std::memory_order_release); }
+	};
+
+	class job_system
+	{
+	public:
+		// -1 uses one worker per core, leaving one for the calling thread
+		job_system(int threads = -1);
+		~job_system();
+
+		job_system(const job_system&) = delete;
+		job_system& operator=(const job_system&) = delete;
+
+		// Increments the counter, which is decremented again once the job has run
+		void submit(job j, job_counter* counter = nullptr);
+		// Runs jobs on the calling thread until the counter reaches 0
+		void wait(job_counter& counter);
+
+		// Calls f(begin, end) over [0, count) in ranges of chunk_size, 0 picks a size from the worker count
+		template<typename F>
+		void parallel_for(uint32_t count, uint32_t chunk_size, F f);
+
+		int size() const { return worker_count; }
+		// 0 for the thread that created the job system (and any other thread), 1 to size() for workers
+		int thread_index();
+
+#if ENGINE_PROFILE
+		// Nanoseconds the thread has spent running jobs, a job run while waiting inside another only counts once
+		uint64_t busy(int thread) const { return busy_ns[thread]; }
+#endif
+
+	private:
+		int worker_count;
+		std::vector<std::thread> threads;
+		std::unique_ptr<job_queue[]> queues; // queues[0] belongs to the thread that created the job system
+
+		std::atomic<int> queued{ 0 };
+		std::atomic<int> sleeping{ 0 };
+		std::atomic<bool> stopping{ false };
+
+		std::mutex m;
+		std::condition_variable cv;
+
+#if ENGINE_PROFILE
+		std::unique_ptr<std::atomic<uint64_t>[]> busy_ns;
+#endif
+
+		void worker(int i);
+
+		bool find_job(int i, job& j);
+		void run(job& j);
+	};
+
+	template<typename F>
+	void job_system::parallel_for(uint32_t count, uint32_t chunk_size, F f)
+	{
+		if (count == 0)
+			return;
+
+		if (chunk_size == 0)
+			chunk_size = std::max(count / ((size() + 1) * 4), (uint32_t)1);
+
+		struct range_state
+		{
+			F* f;
+			std::atomic<uint32_t> next;
+			uint32_t count;
+			uint32_t chunk_size;
+		};
+
+		range_state s;
+		s.f = &f;
+		s.next = 0;
+		s.count = count;
+		s.chunk_size = chunk_size;
+
+		// Every job keeps claiming ranges until none are left, so the ranges balance across however many threads pick one up
+		void (*run_ranges)(void*) = [](void* p)
+		{
+			range_state* s = (range_state*)p;
+
+			uint32_t b;
+			while ((b = s->next.fetch_add(s->chunk_size)) < s->count)
+				(*s->f)(b, std::min(b + s->chunk_size, s->count));
+		};
+
+		uint32_t ranges = (count + chunk_size - 1) / chunk_size;
+		int helpers = std::min((uint32_t)size(), ranges - 1);
+
+		job_counter c(0);
+		for (int i = 0; i < helpers; i++)
+			submit(job{ run_ranges, &s }, &c);
+
+		run_ranges(&s);
+		wait(c);
+	}
+}
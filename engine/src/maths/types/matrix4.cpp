@@ -0,0 +1,52 @@
+#include "pch.h"
+#include "matrix4.h"
+
+namespace engine
+{
+	matrix4 matrix4::operator*(const matrix4& o) const
+	{
+		matrix4 r;
+
+		for (int c = 0; c < 4; c++)
+		{
+			__m128 col = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(o.m[c * 4]));
+			col = _mm_add_ps(col, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(o.m[c * 4 + 1])));
+			col = _mm_add_ps(col, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(o.m[c * 4 + 2])));
+			col = _mm_add_ps(col, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(o.m[c * 4 + 3])));
+			_mm_storeu_ps(r.m + c * 4, col);
+		}
+
+		return r;
+	}
+
+	matrix4 matrix4::transform(const vector3& pos, const vector3& rot, const vector3& scl)
+	{
+		float cx = cosf(rot.x), sx = sinf(rot.x);
+		float cy = cosf(rot.y), sy = sinf(rot.y);
+		float cz = cosf(rot.z), sz = sinf(rot.z);
+
+		// Rz * Ry * Rx, with each column scaled
+		matrix4 r;
+		r.m[0] = cy * cz * scl.x;
+		r.m[1] = cy * sz * scl.x;
+		r.m[2] = -sy * scl.x;
+		r.m[3] = 0;
+
+		r.m[4] = (sx * sy * cz - cx * sz) * scl.y;
+		r.m[5] = (sx * sy * sz + cx * cz) * scl.y;
+		r.m[6] = sx * cy * scl.y;
+		r.m[7] = 0;
+
+		r.m[8] = (cx * sy * cz + sx * sz) * scl.z;
+		r.m[9] = (cx * sy * sz - sx * cz) * scl.z;
+		r.m[10] = cx * cy * scl.z;
+		r.m[11] = 0;
+
+		r.m[12] = pos.x;
+		r.m[13] = pos.y;
+		r.m[14] = pos.z;
+		r.m[15] = 1;
+
+		return r;
+	}
+}
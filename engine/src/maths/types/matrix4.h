@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pch.h"
+
+#include "maths/types/vector3.h"
+
+namespace engine
+{
+	// Column major, matching GLSL
+	class matrix4
+	{
+	public:
+		float m[16];
+
+		matrix4() : m{ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } {}
+
+		matrix4 operator*(const matrix4& o) const;
+
+		inline vector3 position() const { return vector3(m[12], m[13], m[14]); }
+
+		// Scales, then rotates about x, y and z in that order (in radians), then translates
+		static matrix4 transform(const vector3& pos, const vector3& rot, const vector3& scl);
+	};
+}
@@ -6,6 +6,7 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <bitset>
 #include <tuple>
 #include <array>
@@ -24,5 +25,14 @@
 #include <algorithm>
 #include <optional>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <chrono>
 
 #include <Windows.h>
\ No newline at end of file
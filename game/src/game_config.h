@@ -1,4 +1,6 @@
 #include "ecs/ecs.h"
+#include "ecs/hierarchy.h"
+#include "ecs/scheduler.h"
 
 #include "maths/types/vector3.h"
 
@@ -34,6 +36,7 @@ struct mesh
 	mesh(int i) : id(i) {}
 };
 
+// A tag, entities with it are controlled by the player
 struct input {};
 
 namespace ecs_systems
@@ -52,11 +55,14 @@ namespace ecs_systems
 	}
 
 	// transform, motion
-	void move(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	void move(float dt, engine::span<transform> t, engine::span<motion> m, engine::core_game_objects* cgo)
 	{
-		engine::vector3 vel = e.get<motion>().velocity * dt;
-		e.get<transform>().position = e.get<transform>().position + vel;
-		e.get<motion>().velocity = engine::vector3();
+		for (uint32_t i = 0; i < t.size; i++)
+		{
+			engine::vector3 vel = m[i].velocity * dt;
+			t[i].position = t[i].position + vel;
+			m[i].velocity = engine::vector3();
+		}
 	}
 
 	//transform
@@ -76,20 +82,25 @@ namespace ecs_systems
 			//e.get<motion>().velocity.y -= e.get<motion>().speed;
 	}
 
-	//transform, mesh
+	//world_transform, mesh
 	void update_mesh_ubo(float dt, engine::entity& e, engine::core_game_objects* cgo)
 	{
-		if (e.get<transform>().position.x != 0)
-			std::cout;
+		engine::vector3 pos = e.get<engine::world_transform>().matrix.position();
+
 		engine::mesh_ubo& mu = cgo->r->get_object(e.get<mesh>().id);
-		mu.pos.x += e.get<transform>().position.x;
-		mu.pos.y += e.get<transform>().position.y;
+		mu.pos.x = pos.x;
+		mu.pos.y = pos.y;
+	}
+
+	engine::matrix4 local_matrix(const transform& t)
+	{
+		return engine::matrix4::transform(t.position, t.rotation, t.scale);
 	}
 }
 
 class game
 {
-	float ct, pt;
+	double pt = 0;
 
 public:
 	float dt;
@@ -98,7 +109,9 @@ public:
 	engine::renderer renderer;
 	engine::core_game_objects cgo = engine::core_game_objects(&renderer, &window);
 
-	engine::ecs_manager<transform, motion, mesh, input> ecs;
+	engine::job_system jobs;
+	engine::ecs_manager<transform, motion, mesh, input, engine::parent, engine::world_transform> ecs;
+	engine::fixed_scheduler scheduler = engine::fixed_scheduler(60);
 
 	game();
 
@@ -117,17 +130,21 @@ game::game() : renderer(engine::renderer(&window))
 void game::init()
 {
 	ecs.cgo = &cgo;
-	ecs.add_system<transform, motion, input>(0, ecs_systems::controller);
+	ecs.jobs = &jobs;
+	ecs.add_system<const transform, motion, const input>(0, ecs_systems::controller);
 	ecs.add_system<transform, motion>(1, ecs_systems::move);
-	//ecs.add_system<transform>(2, ecs_systems::print_coords);
-	ecs.add_system<transform, mesh>(2, ecs_systems::update_mesh_ubo);
-	ecs.add_system<mesh>(2, ecs_systems::set_mesh);
+	//ecs.add_system<const transform>(2, ecs_systems::print_coords);
+	ecs.add_transform_propagation<transform>(0, ecs_systems::local_matrix);
+	ecs.add_system<const engine::world_transform, const mesh, engine::changed<engine::world_transform>>(2, ecs_systems::update_mesh_ubo, engine::stage_frame);
+	ecs.add_system<const mesh>(2, ecs_systems::set_mesh, engine::stage_frame);
 
-	engine::entity e1 = ecs.add_entity<transform, motion, mesh>(transform(), motion(3), mesh(1));
-	//engine::entity e2 = ecs.add_entity<transform, motion, mesh>(transform(), motion(3), mesh(1));
+	engine::entity& e1 = ecs.add_entity<transform, motion, mesh, input, engine::world_transform>(transform(), motion(3), mesh(1), input(), engine::world_transform());
+	//engine::entity& e2 = ecs.add_entity<transform, motion, mesh>(transform(), motion(3), mesh(1));
 
 	renderer.add_object(0);
 	renderer.add_object(1);
+
+	pt = glfwGetTime();
 }
 
 void game::exit()
@@ -137,14 +154,13 @@ void game::exit()
 
 void game::update()
 {
+	double ct = glfwGetTime();
 	dt = ct - pt;
-	pt = glfwGetTime();
+	pt = ct;
 
 	window.update();
-	ecs.update(dt);
+	scheduler.update(ecs, dt);
 	engine::input::update();
-
-	ct = glfwGetTime();
 }
 void game::draw()
 {
@@ -0,0 +1,100 @@
+#include "test_config.h"
+
+std::atomic<uint64_t> allocations{ 0 };
+int failures = 0;
+
+// GCC sees free called on what operator new returned once these are inlined, not knowing this operator new is malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// The engine is a static library, so its allocations come through these as well
+void* operator new(size_t size)
+{
+	allocations++;
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept
+{
+	free(p);
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+	allocations++;
+#ifdef _WIN32
+	void* p = _aligned_malloc(size ? size : 1, (size_t)align);
+#else
+	void* p = aligned_alloc((size_t)align, ((size ? size : 1) + (size_t)align - 1) / (size_t)align * (size_t)align);
+#endif
+	if (p)
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t align) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+void operator delete(void* p, size_t size, std::align_val_t align) noexcept
+{
+	operator delete(p, align);
+}
+
+// Usage: tests, returns the number of failed checks
+int main()
+{
+	std::cerr << "update_allocates_nothing" << std::endl;
+	tests::update_allocates_nothing(nullptr);
+	std::cerr << "references_survive_spawning" << std::endl;
+	tests::references_survive_spawning();
+	std::cerr << "references_survive_joining_groups" << std::endl;
+	tests::references_survive_joining_groups();
+	std::cerr << "spawn_n_fills_grouped_pools" << std::endl;
+	tests::spawn_n_fills_grouped_pools();
+
+	std::cerr << "truncated_snapshots_are_refused" << std::endl;
+	tests::truncated_snapshots_are_refused();
+	std::cerr << "corrupt_snapshots_leave_the_world_alone" << std::endl;
+	tests::corrupt_snapshots_leave_the_world_alone();
+	std::cerr << "churn_keeps_a_spare_chunk" << std::endl;
+	tests::churn_keeps_a_spare_chunk();
+
+	std::cerr << "change_ticks_survive_wrapping" << std::endl;
+	tests::change_ticks_survive_wrapping();
+
+	std::cerr << "rollback_restores_sparse_pools" << std::endl;
+	tests::rollback_restores_sparse_pools();
+	std::cerr << "rollback_skips_the_spare_chunk" << std::endl;
+	tests::rollback_skips_the_spare_chunk();
+
+	std::cerr << "hierarchy_recomputes_moved_nodes" << std::endl;
+	tests::hierarchy_recomputes_moved_nodes();
+
+	{
+		engine::job_system jobs;
+		tests::update_allocates_nothing(&jobs);
+
+		std::cerr << "commands_play_back_in_schedule_order" << std::endl;
+		tests::commands_play_back_in_schedule_order(&jobs);
+
+		std::cerr << "shared_components_stay_in_their_world" << std::endl;
+		tests::shared_components_stay_in_their_world(&jobs);
+	}
+
+	std::cerr << (failures ? "FAILED " : "passed ") << failures << std::endl;
+	return failures;
+}
@@ -0,0 +1,685 @@
+#include "ecs/ecs.h"
+#include "ecs/command_buffer.h"
+#include "ecs/hierarchy.h"
+#include "ecs/scheduler.h"
+#include "ecs/rollback.h"
+#include "ecs/snapshot.h"
+
+// Heap allocations made so far, counted by the operator new replacements in main.cpp
+extern std::atomic<uint64_t> allocations;
+
+extern int failures;
+
+#define CHECK(x) if (!(x)) { std::cerr << __FILE__ << ":" << __LINE__ << ": " << #x << std::endl; failures++; }
+
+struct position
+{
+	float x, y, z;
+};
+
+struct velocity
+{
+	float x, y, z;
+};
+
+// Sparse, so the tests cover sparse pools as well as chunks
+struct health
+{
+	int current, max;
+};
+
+namespace engine
+{
+	template<>
+	struct component_storage<::health>
+	{
+		static const storage_policy policy = storage_sparse;
+	};
+}
+
+// Sparse as well, grouped with health by the tests that need an owning group
+struct shield
+{
+	int strength;
+};
+
+namespace engine
+{
+	template<>
+	struct component_storage<::shield>
+	{
+		static const storage_policy policy = storage_sparse;
+	};
+}
+
+struct frozen {};
+
+struct material
+{
+	int id;
+
+	bool operator==(const material& m) const { return id == m.id; }
+};
+
+typedef engine::ecs_manager<position, velocity, health, frozen, engine::parent, engine::world_transform, engine::shared<material>, shield> test_world;
+
+namespace test_systems
+{
+	// position, velocity
+	void integrate(float dt, engine::span<position> p, engine::span<const velocity> v, engine::core_game_objects* cgo)
+	{
+		for (uint32_t i = 0; i < p.size; i++)
+		{
+			p[i].x += v[i].x * dt;
+			p[i].y += v[i].y * dt;
+			p[i].z += v[i].z * dt;
+		}
+	}
+
+	std::atomic<uint32_t> visited{ 0 };
+
+	// position, without frozen
+	void visit(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		if (e.get<position>().x >= 0)
+			visited++;
+	}
+
+	// health
+	void regenerate(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		health& h = e.get<health>();
+		h.current = std::min(h.current + 1, h.max);
+	}
+
+	// changed position
+	void moved(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		visited++;
+	}
+
+	uint32_t changed_count = 0;
+
+	// changed position, run serially
+	void count_changed(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		changed_count++;
+	}
+
+	void on_position(engine::span<engine::entity*> es, engine::core_game_objects* cgo)
+	{
+		visited += es.size;
+	}
+
+	// position, records spawns from whichever thread runs it
+	void spawn_first(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		for (int i = 0; i < 50; i++)
+			e.world().commands().spawn<velocity>(velocity{ 1, (float)i, 0 });
+	}
+
+	// frozen
+	void spawn_second(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		for (int i = 0; i < 50; i++)
+			e.world().commands().spawn<velocity>(velocity{ 2, (float)i, 0 });
+	}
+
+	bool share_refused = false;
+
+	// position, run with the job system
+	void share_material(float dt, engine::entity& e, engine::core_game_objects* cgo)
+	{
+		try
+		{
+			e.world().share(material{ 2 });
+		}
+		catch (std::runtime_error&)
+		{
+			share_refused = true;
+		}
+	}
+
+	engine::matrix4 local_matrix(const position& p)
+	{
+		return engine::matrix4::transform(engine::vector3(p.x, p.y, p.z), engine::vector3(), engine::vector3(1, 1, 1));
+	}
+}
+
+namespace tests
+{
+	// Every truncated copy of a snapshot is refused with an exception rather than read past its end
+	void truncated_snapshots_are_refused()
+	{
+		const std::string path = "tests_snapshot.bin";
+		const std::string truncated = "tests_truncated.bin";
+
+		{
+			engine::ecs_manager<position, velocity, health> w;
+			std::vector<engine::entity_handle> hs = w.spawn_n<position, velocity, health>(3000, [](uint32_t i, position& p, velocity& v, health& h)
+			{
+				p.x = (float)i;
+			});
+			for (uint32_t i = 0; i < hs.size(); i += 3)
+				w.destroy_entity(hs[i]);
+
+			w.save(path);
+		}
+
+		std::ifstream in(path, std::ios::binary);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		in.close();
+
+		{
+			engine::ecs_manager<position, velocity, health> w;
+			w.load(path);
+			CHECK(w.entities.size() == 3000 && w.entities[1].get<position>().x == 1);
+		}
+
+		for (size_t n = 0; n < bytes.size(); n += n < 1024 ? 1 : 509)
+		{
+			std::ofstream out(truncated, std::ios::binary | std::ios::trunc);
+			out.write(bytes.data(), n);
+			out.close();
+
+			engine::ecs_manager<position, velocity, health> w;
+			bool refused = false;
+			try
+			{
+				w.load(truncated);
+			}
+			catch (std::runtime_error&)
+			{
+				refused = true;
+			}
+			CHECK(refused);
+		}
+
+		std::remove(path.c_str());
+		std::remove(truncated.c_str());
+	}
+
+	// Chunks whose entity ids do not lead back to their rows, or whose layout does not match, are refused, and a refused load leaves the world as it was
+	void corrupt_snapshots_leave_the_world_alone()
+	{
+		const std::string path = "tests_snapshot.bin";
+		const std::string corrupt = "tests_corrupt.bin";
+
+		{
+			engine::ecs_manager<position, velocity, health> w;
+			w.spawn_n<position, velocity>(1000, [](uint32_t i, position& p, velocity& v) {});
+			w.save(path);
+		}
+
+		std::ifstream in(path, std::ios::binary);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		in.close();
+
+		engine::snapshot_header h;
+		memcpy(&h, bytes.data(), sizeof(h));
+		size_t archetypes = sizeof(engine::snapshot_header) + h.component_count * sizeof(engine::snapshot_component);
+
+		// The archetype holding every entity, and the offset of its first chunk's entity ids
+		size_t spawned = 0;
+		engine::snapshot_archetype a;
+		for (uint32_t i = 0; i < h.archetype_count; i++)
+		{
+			memcpy(&a, bytes.data() + archetypes + i * sizeof(a), sizeof(a));
+			if (a.count == 1000)
+			{
+				spawned = archetypes + i * sizeof(a);
+				break;
+			}
+		}
+		CHECK(spawned);
+		uint32_t* ids = (uint32_t*)(bytes.data() + a.chunk_offset);
+
+		for (int c = 0; c < 3; c++)
+		{
+			std::vector<char> copy = bytes;
+			uint32_t* copied = (uint32_t*)(copy.data() + a.chunk_offset);
+			if (c == 0)
+				copied[5] = 1000000;
+			else if (c == 1)
+				std::swap(copied[5], copied[6]);
+			else
+				((engine::snapshot_archetype*)(copy.data() + spawned))->capacity = a.capacity - 1;
+
+			std::ofstream out(corrupt, std::ios::binary | std::ios::trunc);
+			out.write(copy.data(), copy.size());
+			out.close();
+
+			engine::ecs_manager<position, velocity, health> w;
+			// Empty, with an archetype left behind by an entity that was destroyed
+			w.destroy_entity(w.add_entity<position>(position()).handle());
+			size_t before = w.archetypes.size();
+			uint32_t tick = w.change_tick;
+
+			bool refused = false;
+			try
+			{
+				w.load(corrupt);
+			}
+			catch (std::runtime_error&)
+			{
+				refused = true;
+			}
+			CHECK(refused && w.archetypes.size() == before && w.change_tick == tick);
+		}
+		CHECK(ids[5] == 5);
+
+		std::remove(path.c_str());
+		std::remove(corrupt.c_str());
+	}
+
+	// An entity coming and going at a chunk boundary reuses the spare chunk rather than allocating one each time
+	void churn_keeps_a_spare_chunk()
+	{
+		engine::ecs_manager<position, velocity, health> w;
+		engine::archetype* a = w.add_entity<position>(position()).arch;
+		w.spawn_n<position>(a->capacity - 1, [](uint32_t i, position& p) {});
+
+		// Once, so the free list has grown
+		w.destroy_entity(w.add_entity<position>(position()).handle());
+
+		uint64_t before = allocations;
+		for (int i = 0; i < 100; i++)
+			w.destroy_entity(w.add_entity<position>(position()).handle());
+		CHECK(allocations == before);
+		CHECK(a->chunks.size() == 2 && a->chunks[1].count == 0);
+
+		// Only the one spare is kept as the archetype empties
+		std::vector<engine::entity_handle> hs;
+		for (engine::entity& e : w.entities)
+		{
+			if (e.alive())
+				hs.push_back(e.handle());
+		}
+		for (engine::entity_handle h : hs)
+			w.destroy_entity(h);
+		CHECK(a->count == 0 && a->chunks.size() == 1);
+	}
+
+	// Frames run before allocations are counted, long enough for every buffer (and the profiler's history) to have grown
+	const uint32_t WARM_UP_FRAMES = 300;
+
+	// Once every buffer has grown, running a frame allocates nothing, with or without the job system
+	void update_allocates_nothing(engine::job_system* jobs)
+	{
+		test_world w;
+		w.jobs = jobs;
+
+		w.add_system<position, const velocity>(3, test_systems::integrate);
+		w.add_system<const position, engine::without<frozen>>(2, test_systems::visit);
+		w.add_system<health>(2, test_systems::regenerate);
+		w.add_system<const position, engine::changed<position>>(1, test_systems::moved, engine::stage_frame);
+		w.add_transform_propagation<position>(0, test_systems::local_matrix);
+		w.add_observer<position>(engine::on_change, test_systems::on_position);
+
+		std::vector<engine::entity_handle> roots = w.spawn_n<position, velocity, engine::world_transform>(10000, [](uint32_t i, position& p, velocity& v, engine::world_transform& t)
+		{
+			v.x = 1;
+		});
+		w.spawn_n<position, velocity, health, frozen>(10000, [](uint32_t i, position& p, velocity& v, health& h, frozen& f)
+		{
+			h.max = 100;
+		});
+		w.spawn_n<position, engine::parent, engine::world_transform>(10000, [&](uint32_t i, position& p, engine::parent& pa, engine::world_transform& t)
+		{
+			pa.handle = roots[i];
+		});
+
+		engine::fixed_scheduler scheduler(60);
+		for (uint32_t i = 0; i < WARM_UP_FRAMES; i++)
+			scheduler.update(w, 1.0 / 60);
+
+		uint64_t before = allocations;
+		for (uint32_t i = 0; i < 100; i++)
+			scheduler.update(w, 1.0 / 60);
+
+		CHECK(allocations == before);
+		CHECK(scheduler.ticks() == WARM_UP_FRAMES + 100);
+	}
+
+	// The velocities spawned by spawn_first and spawn_second, by entity slot
+	std::vector<float> spawn_order(engine::job_system* jobs)
+	{
+		test_world w;
+		w.jobs = jobs;
+
+		w.add_system<const position>(1, test_systems::spawn_first);
+		w.add_system<const frozen>(0, test_systems::spawn_second);
+		w.add_entity<position>(position());
+		w.add_entity<frozen>(frozen());
+
+		for (uint32_t i = 0; i < 4; i++)
+			w.update(0);
+
+		std::vector<float> order;
+		for (engine::entity& e : w.entities)
+		{
+			if (e.alive() && e.has<velocity>())
+				order.push_back(e.get<velocity>().x * 1000 + e.get<velocity>().y);
+		}
+
+		return order;
+	}
+
+	// Commands recorded by systems on different threads play back the same way as when the systems run serially
+	void commands_play_back_in_schedule_order(engine::job_system* jobs)
+	{
+		std::vector<float> serial = spawn_order(nullptr);
+		CHECK(serial.size() == 400);
+
+		for (uint32_t i = 0; i < 50; i++)
+			CHECK(spawn_order(jobs) == serial);
+	}
+
+	// changed<T> reports exactly what was marked while the change tick wraps, and systems running every frame never see aged ticks as changed
+	void change_ticks_survive_wrapping()
+	{
+		test_world w;
+		w.change_tick = UINT32_MAX - 40;
+		w.tick_floor = w.change_tick - engine::MAX_TICK_AGE;
+
+		w.add_system<const position, engine::changed<position>>(0, test_systems::count_changed);
+
+		std::vector<engine::entity_handle> hs;
+		for (uint32_t i = 0; i < 20; i++)
+			hs.push_back(w.add_entity<position>(position()).handle());
+
+		test_systems::changed_count = 0;
+		w.update(0);
+		CHECK(test_systems::changed_count == 20);
+
+		for (uint32_t i = 0; i < 100; i++)
+		{
+			w.get(hs[i % 20])->mark_changed<position>();
+			w.get(hs[(i + 7) % 20])->mark_changed<position>();
+
+			test_systems::changed_count = 0;
+			w.update(0);
+			CHECK(test_systems::changed_count == 2);
+		}
+		CHECK(w.change_tick < 1000);
+
+		// Stands in for a long run, ticks are aged before they could wrap past each other
+		for (uint32_t i = 0; i < 12; i++)
+		{
+			w.change_tick += engine::TICK_AGE_INTERVAL * 2;
+			w.get(hs[3])->mark_changed<position>();
+
+			test_systems::changed_count = 0;
+			w.update(0);
+			CHECK(test_systems::changed_count == 1);
+		}
+
+		// Spawning and destroying outside of systems uses no ticks
+		uint32_t tick = w.change_tick;
+		for (uint32_t i = 0; i < 100; i++)
+			w.destroy_entity(w.add_entity<position>(position()).handle());
+		CHECK(w.change_tick == tick);
+	}
+
+	// Sparse pools are only captured when they changed, and restoring still puts back every write made since the frame
+	void rollback_restores_sparse_pools()
+	{
+		test_world w;
+		w.add_system<health>(0, test_systems::regenerate);
+
+		std::vector<engine::entity_handle> hs;
+		for (uint32_t i = 0; i < 1000; i++)
+			hs.push_back(w.add_entity<position, health>(position(), health{ 0, 100 }).handle());
+
+		engine::rollback_buffer rb(w, 4);
+		uint32_t first = rb.capture();
+
+		// Nothing changed, so the pool is not copied again
+		uint32_t unchanged = rb.capture();
+		CHECK(rb.bytes(unchanged) < rb.bytes(first) / 2);
+
+		w.update(0);
+		uint32_t regenerated = rb.capture();
+		CHECK(rb.bytes(regenerated) > 1000 * sizeof(health));
+
+		// Written outside of a system, and removed, after the last capture
+		w.get(hs[0])->get<health>().current = 50;
+		w.get(hs[0])->mark_changed<health>();
+		w.get(hs[1])->remove<health>();
+
+		rb.restore(regenerated);
+		CHECK(w.get(hs[0])->get<health>().current == 1 && w.get(hs[1])->has<health>());
+
+		rb.restore(unchanged);
+		CHECK(w.get(hs[0])->get<health>().current == 0 && w.pool<health>().size() == 1000);
+	}
+
+	// Rolling back past a chunk that was filled after the frame leaves it as the empty spare, with nothing restored into it
+	void rollback_skips_the_spare_chunk()
+	{
+		test_world w;
+		engine::archetype* a = w.add_entity<position>(position()).arch;
+		w.spawn_n<position>(a->capacity - 1, [](uint32_t i, position& p) {});
+
+		engine::rollback_buffer rb(w, 4);
+		uint32_t full = rb.capture();
+
+		engine::entity_handle h = w.add_entity<position>(position{ 1, 2, 3 }).handle();
+		rb.capture();
+
+		rb.restore(full);
+		CHECK(!w.alive(h) && a->count == a->capacity && a->chunks.size() == 2 && a->chunks[1].count == 0);
+	}
+
+	// Shared components hold pointers into the world, so they are refused by save, and share is refused while systems run
+	void shared_components_stay_in_their_world(engine::job_system* jobs)
+	{
+		test_world w;
+		w.jobs = jobs;
+
+		engine::shared<material> m = w.share(material{ 1 });
+		CHECK(w.share(material{ 1 }) == m);
+		w.add_entity<position, engine::shared<material>>(position(), m);
+
+		bool refused = false;
+		try
+		{
+			w.save("tests_shared.bin");
+		}
+		catch (std::runtime_error&)
+		{
+			refused = true;
+		}
+		CHECK(refused);
+
+		w.add_system<const position>(0, test_systems::share_material);
+		test_systems::share_refused = false;
+		w.update(0);
+		CHECK(test_systems::share_refused);
+		CHECK(w.share(material{ 2 }) != m);
+	}
+
+	// Rows of world_transform written after the tick
+	uint32_t transforms_written(test_world& w, uint32_t tick)
+	{
+		engine::component_index id = engine::component_type<engine::world_transform>::id;
+
+		uint32_t n = 0;
+		for (engine::archetype* a : w.archetypes)
+		{
+			if (!a->has(id))
+				continue;
+
+			for (engine::chunk& c : a->chunks)
+			{
+				for (uint32_t i = 0; i < c.count; i++)
+					n += engine::newer(a->ticks(c, id)[i], tick);
+			}
+		}
+
+		return n;
+	}
+
+	// Spawning or reparenting a node rebuilds the hierarchy but only recomputes the nodes that moved, and their subtrees
+	void hierarchy_recomputes_moved_nodes()
+	{
+		test_world w;
+		w.add_transform_propagation<position>(0, test_systems::local_matrix);
+
+		std::vector<engine::entity_handle> hs;
+		for (uint32_t i = 0; i < 15000; i++)
+		{
+			if (i < 1000)
+				hs.push_back(w.add_entity<position, engine::world_transform>(position{ 1, 0, 0 }, engine::world_transform()).handle());
+			else
+				hs.push_back(w.add_entity<position, engine::parent, engine::world_transform>(position{ 1, 0, 0 }, engine::parent{ hs[i - 1000] }, engine::world_transform()).handle());
+		}
+		w.update(0);
+
+		engine::entity_handle leaf = w.add_entity<position, engine::parent, engine::world_transform>(position{ 0, 1, 0 }, engine::parent{ hs[14999] }, engine::world_transform()).handle();
+		uint32_t tick = w.change_tick;
+		w.update(0);
+		CHECK(transforms_written(w, tick) == 1);
+		CHECK(w.get(leaf)->get<engine::world_transform>().matrix.position().y == 1);
+
+		// Moves a chain of 14 nodes under another root, and makes a chain of 14 roots of its own
+		w.get(hs[1000])->add<engine::parent>(engine::parent{ hs[1] });
+		w.destroy_entity(hs[2]);
+		tick = w.change_tick;
+		w.update(0);
+		CHECK(transforms_written(w, tick) == 28);
+		CHECK(w.get(leaf)->get<engine::world_transform>().matrix.position().x == 15);
+		CHECK(w.get(hs[1002])->get<engine::world_transform>().matrix.position().x == 1);
+	}
+
+	// Entities spawned into the pools of an owning group get the values init gave them, although each add can reorder the group
+	void spawn_n_fills_grouped_pools()
+	{
+		test_world w;
+		w.add_group<health, shield>();
+
+		std::vector<engine::entity_handle> existing;
+		for (int i = 0; i < 20; i++)
+		{
+			if (i % 3 == 0)
+				existing.push_back(w.add_entity<position, health>(position(), health{ i, 0 }).handle());
+			else if (i % 3 == 1)
+				existing.push_back(w.add_entity<position, shield>(position(), shield{ i }).handle());
+			else
+				existing.push_back(w.add_entity<position, health, shield>(position(), health{ i, 0 }, shield{ i }).handle());
+		}
+
+		std::vector<engine::entity_handle> hs = w.spawn_n<position, health, shield>(10, [](uint32_t i, position& p, health& h, shield& s)
+		{
+			h.current = 100 + i;
+			s.strength = 200 + i;
+		});
+
+		for (uint32_t i = 0; i < hs.size(); i++)
+		{
+			engine::entity* e = w.get(hs[i]);
+			CHECK(e->get<health>().current == (int)(100 + i) && e->get<shield>().strength == (int)(200 + i));
+		}
+		for (int i = 0; i < (int)existing.size(); i++)
+		{
+			engine::entity* e = w.get(existing[i]);
+			CHECK(i % 3 == 1 || e->get<health>().current == i);
+			CHECK(i % 3 == 0 || e->get<shield>().strength == i);
+		}
+	}
+
+	// References to components stay valid while entities are spawned around them
+	// Entity references are not held, entities is a vector and moves as it grows, so the entity is looked up again through its handle
+	void references_survive_spawning()
+	{
+		test_world w;
+		std::vector<engine::entity_handle> held;
+		std::vector<position*> positions;
+		std::vector<health*> healths;
+
+		for (uint32_t i = 0; i < 200; i++)
+		{
+			engine::entity& e = w.add_entity<position, velocity, health>(position{ (float)i, 0, 0 }, velocity(), health{ (int)i, 100 });
+			held.push_back(e.handle());
+			positions.push_back(&e.get<position>());
+			healths.push_back(&e.get<health>());
+
+			// Fills several chunks and pool pages between each held entity
+			w.spawn_n<position, velocity, health>(500, [](uint32_t i, position& p, velocity& v, health& h) {});
+			for (uint32_t j = 0; j < 50; j++)
+				w.add_entity<position, velocity, health>(position(), velocity(), health());
+
+			// Older entities' slots are reused, so their new occupants spawn while older references are held
+			if (i % 10 == 9)
+			{
+				std::vector<engine::entity_handle> hs = w.spawn_n<velocity, health>(100, [](uint32_t i, velocity& v, health& h) {});
+				for (engine::entity_handle h : hs)
+					w.destroy_entity(h);
+			}
+
+			for (uint32_t j = 0; j <= i; j++)
+			{
+				engine::entity* e = w.get(held[j]);
+				CHECK(e && &e->get<position>() == positions[j] && positions[j]->x == j);
+				CHECK(e && &e->get<health>() == healths[j] && healths[j]->current == (int)j);
+			}
+		}
+
+		// Removing other entities' components moves the pool's last entries into their place, so held entities are looked up again
+		for (engine::entity& e : w.entities)
+		{
+			if (e.alive() && e.has<health>() && e.get<position>().x == 0 && &e.get<health>() != healths[0])
+				e.remove<health>();
+		}
+		for (uint32_t j = 0; j < held.size(); j++)
+			CHECK(w.get(held[j])->get<health>().current == (int)j);
+	}
+
+	// Entities already in an owning group keep their entries while others join it, leaving reorders the group as removing does
+	void references_survive_joining_groups()
+	{
+		test_world w;
+		w.add_group<health, shield>();
+
+		std::vector<engine::entity_handle> held;
+		std::vector<health*> healths;
+		std::vector<shield*> shields;
+		std::vector<engine::entity_handle> others;
+
+		for (uint32_t i = 0; i < 100; i++)
+		{
+			engine::entity& e = w.add_entity<position, health, shield>(position(), health{ (int)i, 100 }, shield{ (int)i });
+			held.push_back(e.handle());
+			healths.push_back(&e.get<health>());
+			shields.push_back(&e.get<shield>());
+
+			// Entities outside the group, half of them joining it once they gain the other component
+			std::vector<engine::entity_handle> hs = w.spawn_n<position, health>(20, [](uint32_t i, position& p, health& h) { h.current = -1; });
+			std::vector<engine::entity_handle> ss = w.spawn_n<position, shield>(20, [](uint32_t i, position& p, shield& s) { s.strength = -1; });
+			for (uint32_t j = 0; j < 10; j++)
+				w.get(hs[j])->add<shield>(shield{ -1 });
+			w.spawn_n<position, health, shield>(10, [](uint32_t i, position& p, health& h, shield& s) { h.current = -1; });
+
+			others.insert(others.end(), hs.begin(), hs.end());
+			others.insert(others.end(), ss.begin(), ss.end());
+
+			for (uint32_t j = 0; j <= i; j++)
+			{
+				engine::entity* e = w.get(held[j]);
+				CHECK(&e->get<health>() == healths[j] && healths[j]->current == (int)j);
+				CHECK(&e->get<shield>() == shields[j] && shields[j]->strength == (int)j);
+			}
+		}
+
+		for (uint32_t j = 0; j < others.size(); j += 2)
+			w.get(others[j])->remove<health>();
+		for (uint32_t j = 1; j < others.size(); j += 4)
+			w.destroy_entity(others[j]);
+
+		for (uint32_t j = 0; j < held.size(); j++)
+		{
+			engine::entity* e = w.get(held[j]);
+			CHECK(e->get<health>().current == (int)j && e->get<shield>().strength == (int)j);
+		}
+	}
+}